@@ -128,7 +128,14 @@ CAddrDB::CAddrDB()
 
 bool CAddrDB::Write(const CAddrMan& addr)
 {
-    return SerializeFileDB("peers", pathAddr, addr);
+    // Serialize into memory first: CAddrMan holds its lock for the whole of
+    // serialization, and SerializeDB walks the data twice (once for the file,
+    // once for the checksum). Doing both against a buffer keeps outbound
+    // connection selection and addr processing from waiting on disk I/O.
+    // The resulting file is byte-for-byte what serializing addr would give.
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addr;
+    return SerializeFileDB("peers", pathAddr, ssPeers);
 }
 
 bool CAddrDB::Read(CAddrMan& addr)
@@ -342,50 +342,67 @@ void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
     }
 }
 
-CAddrInfo CAddrMan::Select_(bool newOnly)
+void CAddrMan::InvalidateSnapshot()
 {
-    if (size() == 0)
+    std::atomic_store(&snapshot, std::shared_ptr<const CAddrManSnapshot>());
+}
+
+std::shared_ptr<const CAddrManSnapshot> CAddrMan::GetSnapshot()
+{
+    std::shared_ptr<const CAddrManSnapshot> snap = std::atomic_load(&snapshot);
+    if (snap)
+        return snap;
+
+    LOCK(cs);
+    // Another reader may have published one while we waited for the lock.
+    snap = std::atomic_load(&snapshot);
+    if (snap)
+        return snap;
+
+    std::shared_ptr<CAddrManSnapshot> snapNew = std::make_shared<CAddrManSnapshot>();
+    snapNew->vInfo.reserve(vRandom.size());
+    for (unsigned int n = 0; n < vRandom.size(); n++) {
+        assert(mapInfo.count(vRandom[n]) == 1);
+        snapNew->vInfo.push_back(mapInfo[vRandom[n]]);
+    }
+    snapNew->vTriedPos.reserve(nTried);
+    for (int nKBucket = 0; nKBucket < ADDRMAN_TRIED_BUCKET_COUNT; nKBucket++) {
+        for (int nKBucketPos = 0; nKBucketPos < ADDRMAN_BUCKET_SIZE; nKBucketPos++) {
+            if (vvTried[nKBucket][nKBucketPos] != -1)
+                snapNew->vTriedPos.push_back(mapInfo[vvTried[nKBucket][nKBucketPos]].nRandomPos);
+        }
+    }
+    snapNew->vNewPos.reserve(nNew);
+    for (int nUBucket = 0; nUBucket < ADDRMAN_NEW_BUCKET_COUNT; nUBucket++) {
+        for (int nUBucketPos = 0; nUBucketPos < ADDRMAN_BUCKET_SIZE; nUBucketPos++) {
+            if (vvNew[nUBucket][nUBucketPos] != -1)
+                snapNew->vNewPos.push_back(mapInfo[vvNew[nUBucket][nUBucketPos]].nRandomPos);
+        }
+    }
+
+    snap = snapNew;
+    std::atomic_store(&snapshot, snap);
+    return snap;
+}
+
+CAddrInfo CAddrMan::Select_(const CAddrManSnapshot& snap, bool newOnly)
+{
+    if (snap.vInfo.empty())
         return CAddrInfo();
 
-    if (newOnly && nNew == 0)
+    if (newOnly && snap.vNewPos.empty())
         return CAddrInfo();
 
     // Use a 50% chance for choosing between tried and new table entries.
-    if (!newOnly &&
-       (nTried > 0 && (nNew == 0 || RandomInt(2) == 0))) { 
-        // use a tried node
-        double fChanceFactor = 1.0;
-        while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
-    } else {
-        // use a new node
-        double fChanceFactor = 1.0;
-        while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
-            if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
+    // Every occupied bucket position is equally likely, as with a walk over the tables.
+    const std::vector<int>& vPos = (!newOnly &&
+       (!snap.vTriedPos.empty() && (snap.vNewPos.empty() || RandomInt(2) == 0))) ? snap.vTriedPos : snap.vNewPos;
+    double fChanceFactor = 1.0;
+    while (1) {
+        const CAddrInfo& info = snap.vInfo[vPos[RandomInt(vPos.size())]];
+        if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
+            return info;
+        fChanceFactor *= 1.2;
     }
 }
 
@@ -467,22 +484,25 @@ int CAddrMan::Check_()
 }
 #endif
 
-void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
+void CAddrMan::GetAddr_(const CAddrManSnapshot& snap, std::vector<CAddress>& vAddr)
 {
-    unsigned int nNodes = ADDRMAN_GETADDR_MAX_PCT * vRandom.size() / 100;
+    unsigned int nNodes = ADDRMAN_GETADDR_MAX_PCT * snap.vInfo.size() / 100;
     if (nNodes > ADDRMAN_GETADDR_MAX)
         nNodes = ADDRMAN_GETADDR_MAX;
 
-    // gather a list of random nodes, skipping those of low quality
-    for (unsigned int n = 0; n < vRandom.size(); n++) {
+    // gather a list of random nodes, skipping those of low quality; the
+    // snapshot is shared, so shuffle a private list of positions into it
+    std::vector<int> vPos(snap.vInfo.size());
+    for (unsigned int n = 0; n < vPos.size(); n++)
+        vPos[n] = n;
+    for (unsigned int n = 0; n < vPos.size(); n++) {
         if (vAddr.size() >= nNodes)
             break;
 
-        int nRndPos = RandomInt(vRandom.size() - n) + n;
-        SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        int nRndPos = RandomInt(vPos.size() - n) + n;
+        std::swap(vPos[n], vPos[nRndPos]);
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = snap.vInfo[vPos[n]];
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -15,6 +15,7 @@
 #include "util.h"
 
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <vector>
@@ -177,6 +178,23 @@ public:
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/**
+ * Read-only copy of the address tables, published by CAddrMan so that Select
+ * and GetAddr do not have to take its lock.
+ */
+class CAddrManSnapshot
+{
+public:
+    //! all entries, in the order of CAddrMan::vRandom
+    std::vector<CAddrInfo> vInfo;
+
+    //! index into vInfo for every occupied "tried" bucket position
+    std::vector<int> vTriedPos;
+
+    //! index into vInfo for every occupied "new" bucket position (an entry appears once per bucket referencing it)
+    std::vector<int> vNewPos;
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -213,6 +231,10 @@ private:
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
+    //! tables as of the last change, only accessed through std::atomic_load and std::atomic_store (memory only).
+    //! Add calls that only refresh the nTime or nServices of a known entry keep it.
+    std::shared_ptr<const CAddrManSnapshot> snapshot;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -248,10 +270,17 @@ protected:
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime);
 
-    //! Select an address to connect to, if newOnly is set to true, only the new table is selected from.
-    CAddrInfo Select_(bool newOnly);
+    //! Drop the published snapshot after the tables changed.
+    void InvalidateSnapshot();
+
+    //! Return the published snapshot, building and publishing a new one under cs if the tables changed since.
+    std::shared_ptr<const CAddrManSnapshot> GetSnapshot();
+
+    //! Select an address to connect to from a snapshot, if newOnly is set to true, only the new table is selected from.
+    CAddrInfo Select_(const CAddrManSnapshot& snap, bool newOnly);
 
     //! Wraps GetRandInt to allow tests to override RandomInt and make it determinismistic.
+    //! Select and GetAddr call it without holding cs.
     virtual int RandomInt(int nMax);
 
 #ifdef DEBUG_ADDRMAN
@@ -259,8 +288,8 @@ protected:
     int Check_();
 #endif
 
-    //! Select several addresses at once.
-    void GetAddr_(std::vector<CAddress> &vAddr);
+    //! Select several addresses at once from a snapshot.
+    void GetAddr_(const CAddrManSnapshot& snap, std::vector<CAddress> &vAddr);
 
     //! Mark an entry as currently-connected-to.
     void Connected_(const CService &addr, int64_t nTime);
@@ -475,6 +504,7 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        InvalidateSnapshot();
     }
 
     CAddrMan()
@@ -516,6 +546,7 @@ public:
         fRet |= Add_(addr, source, nTimePenalty);
         Check();
         if (fRet) {
+            InvalidateSnapshot();
             LogPrint(BCLog::ADDRMAN, "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(), nTried, nNew);
         }
         return fRet;
@@ -533,6 +564,7 @@ public:
             nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
         Check();
         if (nAdd) {
+            InvalidateSnapshot();
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
         }
         return nAdd > 0;
@@ -544,6 +576,7 @@ public:
         LOCK(cs);
         Check();
         Good_(addr, nTime);
+        InvalidateSnapshot();
         Check();
     }
 
@@ -553,34 +586,26 @@ public:
         LOCK(cs);
         Check();
         Attempt_(addr, fCountFailure, nTime);
+        InvalidateSnapshot();
         Check();
     }
 
     /**
      * Choose an address to connect to.
+     * Reads the published snapshot, so cs is only taken to rebuild it after the tables changed.
      */
     CAddrInfo Select(bool newOnly = false)
     {
-        CAddrInfo addrRet;
-        {
-            LOCK(cs);
-            Check();
-            addrRet = Select_(newOnly);
-            Check();
-        }
-        return addrRet;
+        std::shared_ptr<const CAddrManSnapshot> snap = GetSnapshot();
+        return Select_(*snap, newOnly);
     }
 
     //! Return a bunch of addresses, selected at random.
     std::vector<CAddress> GetAddr()
     {
-        Check();
+        std::shared_ptr<const CAddrManSnapshot> snap = GetSnapshot();
         std::vector<CAddress> vAddr;
-        {
-            LOCK(cs);
-            GetAddr_(vAddr);
-        }
-        Check();
+        GetAddr_(*snap, vAddr);
         return vAddr;
     }
 
@@ -590,6 +615,7 @@ public:
         LOCK(cs);
         Check();
         Connected_(addr, nTime);
+        InvalidateSnapshot();
         Check();
     }
 
@@ -598,6 +624,7 @@ public:
         LOCK(cs);
         Check();
         SetServices_(addr, nServices);
+        InvalidateSnapshot();
         Check();
     }
 
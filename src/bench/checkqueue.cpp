@@ -100,5 +100,54 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark measures how the CheckQueue scales with the number of
+// threads (including the master), using checks that each do a fixed amount
+// of work, roughly like verifying a block with many small transactions.
+static const size_t SCALING_BATCHES = 2000;
+static const size_t SCALING_BATCH_SIZE = 3;
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct FixedWorkJob {
+        uint64_t x {0};
+        bool operator()()
+        {
+            for (int i = 0; i < 1000; ++i)
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            return true;
+        }
+        void swap(FixedWorkJob& other){std::swap(x, other.x);};
+    };
+    CCheckQueue<FixedWorkJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<FixedWorkJob> control(&queue);
+        for (size_t i = 0; i < SCALING_BATCHES; ++i) {
+            std::vector<FixedWorkJob> vChecks(SCALING_BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1);
+BENCHMARK(CCheckQueueScaling2);
+BENCHMARK(CCheckQueueScaling4);
+BENCHMARK(CCheckQueueScaling8);
+BENCHMARK(CCheckQueueScaling16);
+BENCHMARK(CCheckQueueScaling32);
+BENCHMARK(CCheckQueueScaling64);
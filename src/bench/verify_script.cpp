@@ -106,4 +106,29 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Microbenchmark for the stack handling of the script interpreter, without
+// signature checks: copies and comparisons of a hash preimage, close to the
+// opcode limit, followed by a hash lock.
+static void VerifyScriptStackOpsBench(benchmark::State& state)
+{
+    const std::vector<unsigned char> preimage(32, 0x42);
+    uint160 hash;
+    CHash160().Write(preimage.data(), preimage.size()).Finalize(hash.begin());
+
+    CScript script;
+    script << OP_DUP;
+    for (int i = 0; i < 39; ++i)
+        script << OP_2DUP << OP_EQUALVERIFY << OP_OVER << OP_SWAP << OP_DROP;
+    script << OP_DROP << OP_HASH160 << ToByteVector(hash) << OP_EQUAL;
+
+    while (state.KeepRunning()) {
+        std::vector<std::vector<unsigned char> > stack(1, preimage);
+        ScriptError err;
+        bool success = EvalScript(stack, script, SCRIPT_VERIFY_MINIMALDATA, BaseSignatureChecker(), SIGVERSION_WITNESS_V0, &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
 BENCHMARK(VerifyScriptBench);
+BENCHMARK(VerifyScriptStackOpsBench);
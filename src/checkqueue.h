@@ -9,6 +9,8 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -26,105 +28,150 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every Add() publishes its checks as one batch at the end of a linked
+  * list. Threads claim ranges of a batch by atomically advancing the
+  * batch's own index, and each thread keeps its own cursor into the list,
+  * moving on to (and stealing from) later batches once its current one is
+  * exhausted. Neither adding nor claiming work takes a lock; the mutex is
+  * only used to park idle threads and wake them up again.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    /** The checks passed to one call of Add(). */
+    struct Batch {
+        std::vector<T> checks;
+        //! Index of the first unclaimed check; may run past the end.
+        std::atomic<size_t> nNext{0};
+        std::atomic<Batch*> pNext{nullptr};
+    };
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    //! First batch of the current round, or nullptr when there is no work.
+    std::atomic<Batch*> pHead{nullptr};
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    //! Last batch of the current round. Only used by the master.
+    Batch* pTail;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Incremented whenever the batches of a round are freed, invalidating cursors.
+    std::atomic<uint64_t> nRound{0};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Incremented on every Add(), so parked workers can tell new work arrived.
+    std::atomic<uint64_t> nGeneration{0};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Number of workers currently walking the batch list.
+    std::atomic<int> nActive{0};
+
+    //! The number of worker threads (excluding the master).
+    std::atomic<int> nWorkers{0};
+
+    //! The number of workers that are parked.
+    std::atomic<int> nIdle{0};
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that have been claimed, but are still being
+     * run by a worker.
      */
-    unsigned int nTodo;
+    std::atomic<size_t> nTodo{0};
+
+    //! Only protects parking; idle threads block on the condition variables.
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    /**
+     * Claim a range [nBegin, nEnd) of checks, starting at pCursor and
+     * following the list. pCursor is left at the batch the range is from,
+     * or at the last batch if there is nothing left to claim.
+     */
+    bool Claim(Batch*& pCursor, size_t& nBegin, size_t& nEnd)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+        while (true) {
+            const size_t nSize = pCursor->checks.size();
+            const size_t nNext = pCursor->nNext.load(std::memory_order_relaxed);
+            if (nNext < nSize) {
+                // Aim for increasingly smaller ranges so all threads finish
+                // approximately simultaneously, like the old shared queue did.
+                const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, (nSize - nNext) / (nWorkers.load(std::memory_order_relaxed) + 2)));
+                nBegin = pCursor->nNext.fetch_add(nNow);
+                if (nBegin < nSize) {
+                    nEnd = std::min(nBegin + nNow, nSize);
+                    return true;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+            Batch* pNext = pCursor->pNext.load(std::memory_order_acquire);
+            if (pNext == nullptr)
+                return false;
+            pCursor = pNext;
+        }
+    }
+
+    /** Run a claimed range of checks, and release their resources. */
+    void Run(Batch* pBatch, size_t nBegin, size_t nEnd)
+    {
+        // Check whether we need to do work at all
+        bool fOk = fAllOk.load(std::memory_order_relaxed);
+        for (size_t i = nBegin; i < nEnd; i++) {
+            T& check = pBatch->checks[i];
+            if (fOk)
+                fOk = check();
+            // Free what the check holds now rather than when the round ends
+            T().swap(check);
+        }
+        if (!fOk)
+            fAllOk.store(false);
+        if (nTodo.fetch_sub(nEnd - nBegin) == nEnd - nBegin) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
+    /** Process work until none is left to claim, as a worker. */
+    void RunWorker(Batch*& pCursor, uint64_t& nCursorRound)
+    {
+        nActive++;
+        Batch* pFirst = pHead.load();
+        if (pFirst != nullptr) {
+            // pHead is read first: a new round's batches imply its nRound is visible
+            const uint64_t nCurrentRound = nRound.load();
+            if (pCursor == nullptr || nCursorRound != nCurrentRound) {
+                pCursor = pFirst;
+                nCursorRound = nCurrentRound;
+            }
+            size_t nBegin, nEnd;
+            while (Claim(pCursor, nBegin, nEnd))
+                Run(pCursor, nBegin, nEnd);
+        }
+        nActive--;
+    }
+
+    /** Free the batches of a finished round. Only called by the master. */
+    void FreeBatches()
+    {
+        Batch* pBatch = pHead.exchange(nullptr);
+        pTail = nullptr;
+        // Workers may still be looking for work in the list
+        while (nActive.load() != 0)
+            std::this_thread::yield();
+        while (pBatch != nullptr) {
+            Batch* pNext = pBatch->pNext.load(std::memory_order_relaxed);
+            delete pBatch;
+            pBatch = pNext;
+        }
+        nRound++;
     }
 
 public:
@@ -132,37 +179,84 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : pTail(nullptr), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        Batch* pCursor = nullptr;
+        uint64_t nCursorRound = 0;
+        nWorkers++;
+        try {
+            while (true) {
+                const uint64_t nSeen = nGeneration.load();
+                RunWorker(pCursor, nCursorRound);
+                boost::unique_lock<boost::mutex> lock(mutex);
+                nIdle++;
+                while (nGeneration.load() == nSeen)
+                    condWorker.wait(lock); // wait
+                nIdle--;
+            }
+        } catch (const boost::thread_interrupted&) {
+            // Interrupted while parked
+            nIdle--;
+            nWorkers--;
+            throw;
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        Batch* pCursor = pHead.load();
+        if (pCursor != nullptr) {
+            size_t nBegin, nEnd;
+            while (Claim(pCursor, nBegin, nEnd))
+                Run(pCursor, nBegin, nEnd);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nTodo.load() != 0)
+                condMaster.wait(lock);
+        }
+        bool fRet = fAllOk.load();
+        // reset the status for new work later
+        fAllOk.store(true);
+        FreeBatches();
+        return fRet;
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        Batch* pBatch = new Batch;
+        pBatch->checks.resize(vChecks.size());
+        for (size_t i = 0; i < vChecks.size(); i++)
+            pBatch->checks[i].swap(vChecks[i]);
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        if (pTail != nullptr)
+            pTail->pNext.store(pBatch, std::memory_order_release);
+        else
+            pHead.store(pBatch);
+        pTail = pBatch;
+        nGeneration++;
+        if (nIdle.load() != 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
     {
+        Batch* pBatch = pHead.load();
+        while (pBatch != nullptr) {
+            Batch* pNext = pBatch->pNext.load(std::memory_order_relaxed);
+            delete pBatch;
+            pBatch = pNext;
+        }
     }
 
 };
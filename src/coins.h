@@ -237,6 +237,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Cache an unspent coin read from the backing view ahead of time, exactly
+     * as a later lookup would have. Outpoints already cached are left alone.
+     * The coin must be what the backing view currently holds.
+     */
+    void PrefetchCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -138,7 +138,12 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
 
 int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& inputs, int flags)
 {
-    int64_t nSigOps = GetLegacySigOpCount(tx) * WITNESS_SCALE_FACTOR;
+    return GetLegacySigOpCount(tx) * WITNESS_SCALE_FACTOR + GetTransactionInputSigOpCost(tx, inputs, flags);
+}
+
+int64_t GetTransactionInputSigOpCost(const CTransaction& tx, const CCoinsViewCache& inputs, int flags)
+{
+    int64_t nSigOps = 0;
 
     if (tx.IsCoinBase())
         return nSigOps;
@@ -58,6 +58,17 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  */
 int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& inputs, int flags);
 
+/**
+ * Compute the part of a transaction's signature operation cost that depends
+ * on the outputs it spends: P2SH and witness sigops, but not legacy ones.
+ * GetTransactionSigOpCost is this plus GetLegacySigOpCount * WITNESS_SCALE_FACTOR.
+ * @param[in] tx     Transaction for which we are computing the cost
+ * @param[in] inputs Map of previous transactions that have outputs we're spending
+ * @param[out] flags Script verification flags
+ * @return Input-dependent signature operation cost of tx
+ */
+int64_t GetTransactionInputSigOpCost(const CTransaction& tx, const CCoinsViewCache& inputs, int flags);
+
 /**
  * Check if transaction is final and can be included in a block with the
  * specified height and time. Consensus critical.
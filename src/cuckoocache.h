@@ -23,6 +23,10 @@
  * 2) cache is a cache which is performant in memory usage and lookup speed. It
  * is lockfree for erase operations. Elements are lazily erased on the next
  * insert.
+ *
+ * 3) element_table and atomic_element_table are the storage for the elements
+ * of a cache. With atomic_element_table, reads and erases may also run
+ * concurrently with a write.
  */
 namespace CuckooCache
 {
@@ -116,6 +120,124 @@ public:
     }
 };
 
+/** element_table stores the elements of a cache in a plain vector. It
+ * requires the cache's users to synchronize reads with writes.
+ */
+template <typename Element>
+class element_table
+{
+    std::vector<Element> table;
+
+public:
+    void setup(uint32_t size)
+    {
+        table.resize(size);
+    }
+
+    inline bool equals(uint32_t n, const Element& e) const
+    {
+        return table[n] == e;
+    }
+
+    inline const Element& load(uint32_t n) const
+    {
+        return table[n];
+    }
+
+    inline void store(uint32_t n, Element e)
+    {
+        table[n] = std::move(e);
+    }
+
+    /** swap exchanges the element at index n with e */
+    inline void swap(uint32_t n, Element& e)
+    {
+        std::swap(table[n], e);
+    }
+};
+
+/** atomic_element_table stores the elements of a cache as relaxed atomic
+ * 64-bit words, so that equals() may run concurrently with a single writer.
+ *
+ * Writes are guarded by a sequence counter per stripe of
+ * (1 << STRIPE_BITS) slots: the counter is odd while a slot of the stripe is
+ * being written. equals() only reports a match if it read the same even
+ * counter before and after reading the slot, so it never matches a torn
+ * element. It may miss an element that is being written or moved, which for
+ * a cache is just a miss.
+ *
+ * Element must be trivially copyable and a multiple of 8 bytes in size.
+ * load, store and swap must not run concurrently with each other.
+ */
+template <typename Element>
+class atomic_element_table
+{
+    static_assert(sizeof(Element) % sizeof(uint64_t) == 0, "Element must be a multiple of 64 bits");
+    static const size_t WORDS = sizeof(Element) / sizeof(uint64_t);
+    static const uint32_t STRIPE_BITS = 3;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    std::unique_ptr<std::atomic<uint32_t>[]> versions;
+
+public:
+    void setup(uint32_t size)
+    {
+        words.reset(new std::atomic<uint64_t>[(size_t)size * WORDS]);
+        for (size_t i = 0; i < (size_t)size * WORDS; ++i)
+            words[i].store(0, std::memory_order_relaxed);
+        uint32_t stripes = (size >> STRIPE_BITS) + 1;
+        versions.reset(new std::atomic<uint32_t>[stripes]);
+        for (uint32_t i = 0; i < stripes; ++i)
+            versions[i].store(0, std::memory_order_relaxed);
+    }
+
+    inline bool equals(uint32_t n, const Element& e) const
+    {
+        uint64_t w[WORDS];
+        std::memcpy(w, &e, sizeof(Element));
+        const std::atomic<uint32_t>& version = versions[n >> STRIPE_BITS];
+        uint32_t v = version.load(std::memory_order_acquire);
+        if (v & 1)
+            return false;
+        for (size_t i = 0; i < WORDS; ++i)
+            if (words[n * WORDS + i].load(std::memory_order_relaxed) != w[i])
+                return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == v;
+    }
+
+    inline Element load(uint32_t n) const
+    {
+        uint64_t w[WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+            w[i] = words[n * WORDS + i].load(std::memory_order_relaxed);
+        Element e;
+        std::memcpy(&e, w, sizeof(Element));
+        return e;
+    }
+
+    inline void store(uint32_t n, const Element& e)
+    {
+        uint64_t w[WORDS];
+        std::memcpy(w, &e, sizeof(Element));
+        std::atomic<uint32_t>& version = versions[n >> STRIPE_BITS];
+        uint32_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i)
+            words[n * WORDS + i].store(w[i], std::memory_order_relaxed);
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    /** swap exchanges the element at index n with e */
+    inline void swap(uint32_t n, Element& e)
+    {
+        Element old = load(n);
+        store(n, e);
+        e = old;
+    }
+};
+
 /** cache implements a cache with properties similar to a cuckoo-set
  *
  *  The cache is able to hold up to (~(uint32_t)0) - 1 elements.
@@ -146,6 +268,10 @@ public:
  * 3) Erase requires no concurrent Write, synchronized with last insert.
  * 4) An Erase caller must release all memory before allowing a new Writer.
  *
+ * With Table = atomic_element_table, 2) and 3) are lifted: Reads and Erases
+ * may run concurrently with a Write, at the cost of occasionally missing an
+ * element the Write is moving. Writes still require synchronized access.
+ *
  *
  * Note on function names:
  *   - The name "allow_erase" is used because the real discard happens later.
@@ -155,13 +281,15 @@ public:
  * @tparam Hash should be a function/callable which takes a template parameter
  * hash_select and an Element and extracts a hash from it. Should return
  * high-entropy uint32_t hashes for `Hash h; h<0>(e) ... h<7>(e)`.
+ * @tparam Table is the storage for the elements, element_table or
+ * atomic_element_table
  */
-template <typename Element, typename Hash>
+template <typename Element, typename Hash, typename Table = element_table<Element>>
 class cache
 {
 private:
     /** table stores all the elements */
-    std::vector<Element> table;
+    Table table;
 
     /** size stores the total available slots in the hash table */
     uint32_t size;
@@ -342,7 +470,7 @@ public:
         // depth_limit must be at least one otherwise errors can occur.
         depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
         size = std::max<uint32_t>(2, new_size);
-        table.resize(size);
+        table.setup(size);
         collection_flags.setup(size);
         epoch_flags.resize(size);
         // Set to 45% as described above
@@ -398,7 +526,7 @@ public:
         // Make sure we have not already inserted this element
         // If we have, make sure that it does not get deleted
         for (uint32_t loc : locs)
-            if (table[loc] == e) {
+            if (table.equals(loc, e)) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
                 return;
@@ -408,7 +536,7 @@ public:
             for (uint32_t loc : locs) {
                 if (!collection_flags.bit_is_set(loc))
                     continue;
-                table[loc] = std::move(e);
+                table.store(loc, std::move(e));
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
                 return;
@@ -428,7 +556,7 @@ public:
             * for the next iteration.
             */
             last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
-            std::swap(table[last_loc], e);
+            table.swap(last_loc, e);
             // Can't std::swap a std::vector<bool>::reference and a bool&.
             bool epoch = last_epoch;
             last_epoch = epoch_flags[last_loc];
@@ -468,13 +596,27 @@ public:
     {
         std::array<uint32_t, 8> locs = compute_hashes(e);
         for (uint32_t loc : locs)
-            if (table[loc] == e) {
+            if (table.equals(loc, e)) {
                 if (erase)
                     allow_erase(loc);
                 return true;
             }
         return false;
     }
+
+    /** dump appends every element not marked for collection to out, so that
+     * a snapshot of the cache can be re-inserted into a fresh cache later.
+     *
+     * Not safe to call concurrently with insert.
+     *
+     * @param out the vector to append elements to
+     */
+    void dump(std::vector<Element>& out) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                out.push_back(table.load(i));
+    }
 };
 } // namespace CuckooCache
 
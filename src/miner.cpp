@@ -24,6 +24,7 @@
 #include "script/standard.h"
 #include "timedata.h"
 #include "txmempool.h"
+#include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
@@ -32,6 +33,7 @@
 //#include "wallet/rpcwallet.h"
 
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <algorithm>
 #include <queue>
@@ -104,6 +106,23 @@ static BlockAssembler::Options DefaultOptions(const CChainParams& params)
 
 BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(params, DefaultOptions(params)) {}
 
+/** Set (or replace) the coinbase of a template, paying nFees plus the subsidy to scriptPubKeyIn */
+static void FillCoinbase(CBlockTemplate& tmpl, const CBlockIndex* pindexPrev, const CScript& scriptPubKeyIn, CAmount nFees, const Consensus::Params& consensusParams)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, consensusParams);
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    tmpl.block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    tmpl.vchCoinbaseCommitment = GenerateCoinbaseCommitment(tmpl.block, pindexPrev, consensusParams);
+    tmpl.vTxFees[0] = -nFees;
+    tmpl.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*tmpl.block.vtx[0]);
+}
+
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
@@ -171,16 +190,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     nLastBlockWeight = nBlockWeight;
 
     // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    FillCoinbase(*pblocktemplate, pindexPrev, scriptPubKeyIn, nFees, chainparams.GetConsensus());
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
@@ -189,7 +199,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -452,6 +461,300 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+static CAmount DefaultFeeDeltaNotify()
+{
+    CAmount n = DEFAULT_LONGPOLL_FEE_DELTA;
+    if (gArgs.IsArgSet("-longpollfeedelta"))
+        ParseMoney(gArgs.GetArg("-longpollfeedelta", ""), n);
+    return n;
+}
+
+BlockTemplateCache::BlockTemplateCache(const CChainParams& params) : BlockTemplateCache(params, DefaultOptions(params), DefaultFeeDeltaNotify()) {}
+
+BlockTemplateCache::BlockTemplateCache(const CChainParams& params, const BlockAssembler::Options& optionsIn, CAmount nFeeDeltaNotifyIn) : chainparams(params), options(optionsIn), nFeeDeltaNotify(nFeeDeltaNotifyIn)
+{
+    // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity, as BlockAssembler does
+    options.nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+
+    fStale = false;
+    fIncomplete = false;
+    nTimeBuilt = 0;
+    pindexPrev = nullptr;
+    fMineWitnessTx = false;
+    fIncludeWitness = false;
+    nHeight = 0;
+    nLockTimeCutoff = 0;
+    nBlockWeight = 0;
+    nBlockSigOpsCost = 0;
+    nFees = 0;
+    nSequence = 0;
+    nFeesAvailable = 0;
+    nFeesNotified = 0;
+
+    mempool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateCache::TransactionAddedToMempool, this, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateCache::TransactionRemovedFromMempool, this, _1, _2));
+    mempool.NotifyEntryPrioritised.connect(boost::bind(&BlockTemplateCache::TransactionPrioritised, this, _1));
+    uiInterface.NotifyBlockTip.connect(boost::bind(&BlockTemplateCache::BlockTipChanged, this, _1, _2));
+}
+
+BlockTemplateCache::~BlockTemplateCache()
+{
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&BlockTemplateCache::TransactionAddedToMempool, this, _1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&BlockTemplateCache::TransactionRemovedFromMempool, this, _1, _2));
+    mempool.NotifyEntryPrioritised.disconnect(boost::bind(&BlockTemplateCache::TransactionPrioritised, this, _1));
+    uiInterface.NotifyBlockTip.disconnect(boost::bind(&BlockTemplateCache::BlockTipChanged, this, _1, _2));
+}
+
+void BlockTemplateCache::MarkStale()
+{
+    AssertLockHeld(cs);
+    fStale = true;
+    std::vector<CTransactionRef>().swap(vAdded);
+}
+
+// All notifications are sent with mempool.cs held, which GetTemplate also
+// takes before cs, so the template never sees a half-applied mempool update.
+void BlockTemplateCache::TransactionAddedToMempool(CTransactionRef tx)
+{
+    LOCK(cs);
+    if (!pblocktemplate || fStale)
+        return;
+
+    if (vAdded.size() >= MAX_TEMPLATE_PENDING_TXS) {
+        MarkStale();
+        return;
+    }
+
+    CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+    if (it != mempool.mapTx.end())
+        nFeesAvailable += it->GetModifiedFee();
+    vAdded.push_back(std::move(tx));
+
+    if (nFeeDeltaNotify > 0 && nFeesAvailable - nFeesNotified >= nFeeDeltaNotify) {
+        nFeesNotified = nFeesAvailable;
+        // Notify under csBestBlock so a longpoll waiter can't check the fees
+        // just before this and then sleep through the notification. Waiters
+        // only read nFeesAvailable, so this can't invert any lock order.
+        boost::unique_lock<boost::mutex> lock(csBestBlock);
+        cvBlockChange.notify_all();
+    }
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (setInTemplate.count(tx->GetHash()))
+        MarkStale();
+}
+
+void BlockTemplateCache::TransactionPrioritised(CTransactionRef tx)
+{
+    // A fee delta changes the package feerates the template was selected by
+    LOCK(cs);
+    MarkStale();
+}
+
+void BlockTemplateCache::BlockTipChanged(bool fInitialDownload, const CBlockIndex* pindexNew)
+{
+    // Sent without cs_main, after the tip has changed
+    LOCK(cs);
+    if (pblocktemplate && pindexNew != pindexPrev)
+        MarkStale();
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::GetTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn, uint64_t* pnSequence)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+
+    if (!pblocktemplate || fStale || pindexPrev != chainActive.Tip() ||
+        scriptPubKey != scriptPubKeyIn || fMineWitnessTx != fMineWitnessTxIn ||
+        (fIncomplete && GetTime() - nTimeBuilt > TEMPLATE_REBUILD_INTERVAL)) {
+        Rebuild(scriptPubKeyIn, fMineWitnessTxIn);
+        if (!pblocktemplate)
+            return nullptr;
+    } else if (!vAdded.empty() && !Update()) {
+        Rebuild(scriptPubKeyIn, fMineWitnessTxIn);
+        if (!pblocktemplate)
+            return nullptr;
+    }
+    nFeesAvailable = nFees;
+    nFeesNotified = nFees;
+
+    if (pnSequence)
+        *pnSequence = nSequence;
+    return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
+}
+
+void BlockTemplateCache::Rebuild(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn)
+{
+    // Forget the old template first, so a failure below is retried on the next request
+    pblocktemplate.reset();
+    setInTemplate.clear();
+    vAdded.clear();
+    fStale = false;
+    fIncomplete = false;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplateNew = BlockAssembler(chainparams, options).CreateNewBlock(scriptPubKeyIn, fMineWitnessTxIn);
+    if (!pblocktemplateNew)
+        return;
+    const CBlock& block = pblocktemplateNew->block;
+
+    nTimeBuilt = GetTime();
+    pindexPrev = chainActive.Tip();
+    scriptPubKey = scriptPubKeyIn;
+    fMineWitnessTx = fMineWitnessTxIn;
+    fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
+    nHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                       ? pindexPrev->GetMedianTimePast()
+                       : block.GetBlockTime();
+
+    nBlockWeight = 4000;
+    nBlockSigOpsCost = 400;
+    nFees = -pblocktemplateNew->vTxFees[0];
+    // With an empty template nothing that fails to fit would fit after a rebuild
+    feeRateLowest = CFeeRate(MAX_MONEY);
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        nBlockWeight += GetTransactionWeight(*block.vtx[i]);
+        nBlockSigOpsCost += pblocktemplateNew->vTxSigOpsCost[i];
+        setInTemplate.insert(block.vtx[i]->GetHash());
+        CTxMemPool::txiter it = mempool.mapTx.find(block.vtx[i]->GetHash());
+        if (it != mempool.mapTx.end())
+            feeRateLowest = std::min(feeRateLowest, CFeeRate(it->GetModFeesWithAncestors(), it->GetSizeWithAncestors()));
+    }
+
+    pblocktemplate = std::move(pblocktemplateNew);
+    ++nSequence;
+}
+
+void BlockTemplateCache::GetPackage(CTxMemPool::txiter it, CTxMemPool::setEntries& package, uint64_t& nPackageSize, CAmount& nPackageFees, int64_t& nPackageSigOpsCost) const
+{
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    package.clear();
+    mempool.CalculateMemPoolAncestors(*it, package, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+    package.insert(it);
+
+    nPackageSize = 0;
+    nPackageFees = 0;
+    nPackageSigOpsCost = 0;
+    for (CTxMemPool::setEntries::iterator iit = package.begin(); iit != package.end(); ) {
+        if (setInTemplate.count((*iit)->GetTx().GetHash())) {
+            package.erase(iit++);
+            continue;
+        }
+        nPackageSize += (*iit)->GetTxSize();
+        nPackageFees += (*iit)->GetModifiedFee();
+        nPackageSigOpsCost += (*iit)->GetSigOpCost();
+        ++iit;
+    }
+}
+
+bool BlockTemplateCache::TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package, const CCoinsViewCache& view) const
+{
+    // Same checks as BlockAssembler::TestPackageTransactions, and the inputs
+    // against the tip the template was built on
+    for (const CTxMemPool::txiter& it : package) {
+        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
+        if (!fIncludeWitness && it->GetTx().HasWitness())
+            return false;
+        CValidationState state;
+        CAmount txfee;
+        if (!Consensus::CheckTxInputs(it->GetTx(), state, view, nHeight, txfee)) {
+            LogPrintf("BlockTemplateCache: %s failed input checks: %s\n", it->GetTx().GetHash().ToString(), FormatStateMessage(state));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BlockTemplateCache::Update()
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Consider the new transactions best package feerate first, like
+    // addPackageTxs, so a nearly full template keeps the best paying ones
+    std::vector<std::pair<CFeeRate, CTxMemPool::txiter>> vPackages;
+    for (const CTransactionRef& tx : vAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+        // Already evicted or mined again; nothing to do
+        if (it == mempool.mapTx.end())
+            continue;
+        CTxMemPool::setEntries package;
+        uint64_t nPackageSize;
+        CAmount nPackageFees;
+        int64_t nPackageSigOpsCost;
+        GetPackage(it, package, nPackageSize, nPackageFees, nPackageSigOpsCost);
+        vPackages.emplace_back(CFeeRate(nPackageFees, nPackageSize), it);
+    }
+    vAdded.clear();
+    std::sort(vPackages.begin(), vPackages.end(), [](const std::pair<CFeeRate, CTxMemPool::txiter>& a, const std::pair<CFeeRate, CTxMemPool::txiter>& b) {
+        if (a.first != b.first)
+            return a.first > b.first;
+        return CTxMemPool::CompareIteratorByHash()(a.second, b.second);
+    });
+
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    CCoinsViewCache view(&viewMemPool);
+
+    CBlock& block = pblocktemplate->block;
+    unsigned int nAppended = 0;
+    for (const auto& candidate : vPackages) {
+        CTxMemPool::txiter it = candidate.second;
+        // Appended as the ancestor of an earlier package
+        if (setInTemplate.count(it->GetTx().GetHash()))
+            continue;
+
+        // Same limits as BlockAssembler::addPackageTxs and TestPackage
+        CTxMemPool::setEntries package;
+        uint64_t nPackageSize;
+        CAmount nPackageFees;
+        int64_t nPackageSigOpsCost;
+        GetPackage(it, package, nPackageSize, nPackageFees, nPackageSigOpsCost);
+        if (nPackageFees < options.blockMinFeeRate.GetFee(nPackageSize))
+            continue;
+        if (nBlockWeight + WITNESS_SCALE_FACTOR * nPackageSize >= options.nBlockMaxWeight ||
+            nBlockSigOpsCost + nPackageSigOpsCost >= MAX_BLOCK_SIGOPS_COST) {
+            // A full rebuild would take this package in place of cheaper ones
+            if (CFeeRate(nPackageFees, nPackageSize) > feeRateLowest) {
+                LogPrint(BCLog::BENCH, "BlockTemplateCache: %s outbids the template, rebuilding\n", it->GetTx().GetHash().ToString());
+                return false;
+            }
+            fIncomplete = true;
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries(package.begin(), package.end());
+        std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+        if (!TestPackageTransactions(sortedEntries, view))
+            continue;
+
+        for (const CTxMemPool::txiter& entry : sortedEntries) {
+            block.vtx.emplace_back(entry->GetSharedTx());
+            pblocktemplate->vTxFees.push_back(entry->GetFee());
+            pblocktemplate->vTxSigOpsCost.push_back(entry->GetSigOpCost());
+            nBlockWeight += entry->GetTxWeight();
+            nBlockSigOpsCost += entry->GetSigOpCost();
+            nFees += entry->GetFee();
+            setInTemplate.insert(entry->GetTx().GetHash());
+            ++nAppended;
+        }
+        feeRateLowest = std::min(feeRateLowest, CFeeRate(nPackageFees, nPackageSize));
+    }
+    if (nAppended == 0)
+        return true;
+
+    FillCoinbase(*pblocktemplate, pindexPrev, scriptPubKey, nFees, chainparams.GetConsensus());
+    ++nSequence;
+    nLastBlockTx = block.vtx.size() - 1;
+    nLastBlockWeight = nBlockWeight;
+
+    LogPrint(BCLog::BENCH, "BlockTemplateCache: appended %u txs (total %u, fees %ld): %.2fms\n", nAppended, block.vtx.size() - 1, nFees, 0.001 * (GetTimeMicros() - nTimeStart));
+    return true;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -10,8 +10,10 @@
 #include "primitives/block.h"
 #include "txmempool.h"
 
+#include <atomic>
 #include <stdint.h>
 #include <memory>
+#include <set>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
@@ -202,6 +204,114 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/** Seconds after which a template that is missing mempool transactions is rebuilt */
+static const int64_t TEMPLATE_REBUILD_INTERVAL = 5;
+/** Default for -longpollfeedelta, new mempool fees that end a getblocktemplate longpoll */
+static const CAmount DEFAULT_LONGPOLL_FEE_DELTA = COIN / 10;
+/** Mempool additions collected for a cached template before it is rebuilt instead */
+static const size_t MAX_TEMPLATE_PENDING_TXS = 10000;
+
+/**
+ * Keeps the last template built by BlockAssembler and brings it up to date
+ * on request, instead of assembling a new block every time.
+ *
+ * Transactions that entered the mempool since the last request are appended
+ * together with their in-mempool ancestors that are not in the template yet,
+ * best package feerate first like BlockAssembler::addPackageTxs, provided the
+ * package fits the block limits. Only the appended transactions are checked
+ * again: for finality, witness use and their inputs against the tip.
+ * A new tip, a different coinbase script, a prioritisetransaction call or
+ * removal from the mempool of any transaction in the template forces a full
+ * rebuild. So does a package that does not fit but has a higher ancestor
+ * feerate than the lowest in the template, or one that does not fit once the
+ * template is older than TEMPLATE_REBUILD_INTERVAL.
+ *
+ * Once the template is due for a rebuild, mempool additions are no longer
+ * collected. The same holds after MAX_TEMPLATE_PENDING_TXS of them, so a
+ * template that is no longer requested does not hold on to the mempool.
+ *
+ * Each time the fees available to a new template grow by nFeeDeltaNotify,
+ * cvBlockChange is notified so longpolling getblocktemplate callers can
+ * pick up the updated template.
+ */
+class BlockTemplateCache
+{
+private:
+    const CChainParams& chainparams;
+    BlockAssembler::Options options;
+
+    CCriticalSection cs;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    std::set<uint256> setInTemplate;
+    //! Transactions added to the mempool since the last request
+    std::vector<CTransactionRef> vAdded;
+    //! A transaction in the template left the mempool
+    bool fStale;
+    //! A package could not be appended for lack of room
+    bool fIncomplete;
+    //! Lowest ancestor feerate of the transactions in the template
+    CFeeRate feeRateLowest;
+    int64_t nTimeBuilt;
+
+    // Context the template was built for
+    const CBlockIndex* pindexPrev;
+    CScript scriptPubKey;
+    bool fMineWitnessTx;
+    bool fIncludeWitness;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+
+    // Running totals, these include the coinbase reservation like BlockAssembler
+    uint64_t nBlockWeight;
+    int64_t nBlockSigOpsCost;
+    CAmount nFees;
+
+    //! Incremented whenever the template contents change
+    uint64_t nSequence;
+    //! Fees of the template plus those of vAdded; read without cs
+    std::atomic<CAmount> nFeesAvailable;
+    //! nFeesAvailable when cvBlockChange was last notified
+    CAmount nFeesNotified;
+    CAmount nFeeDeltaNotify;
+
+public:
+    explicit BlockTemplateCache(const CChainParams& params);
+    BlockTemplateCache(const CChainParams& params, const BlockAssembler::Options& optionsIn, CAmount nFeeDeltaNotifyIn = 0);
+    ~BlockTemplateCache();
+
+    /**
+     * Return a copy of the up to date template with coinbase to scriptPubKeyIn.
+     * If pnSequence is given it receives a number that only changes when the
+     * template contents (other than the header) do.
+     */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true, uint64_t* pnSequence=nullptr);
+
+    /** Fees the template would collect if it was updated now */
+    CAmount GetFeesAvailable() const { return nFeesAvailable; }
+    CAmount GetFeeDeltaNotify() const { return nFeeDeltaNotify; }
+
+private:
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+    void TransactionPrioritised(CTransactionRef tx);
+    void BlockTipChanged(bool fInitialDownload, const CBlockIndex* pindexNew);
+
+    /** Force a rebuild on the next request and stop collecting vAdded */
+    void MarkStale();
+
+    /** Build a new template from scratch with BlockAssembler */
+    void Rebuild(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn);
+    /**
+     * Append the usable packages from vAdded and refresh the coinbase.
+     * Returns false if the template should be rebuilt instead.
+     */
+    bool Update();
+    /** Collect a transaction and its ancestors that are not in the template yet */
+    void GetPackage(CTxMemPool::txiter it, CTxMemPool::setEntries& package, uint64_t& nPackageSize, CAmount& nPackageFees, int64_t& nPackageSigOpsCost) const;
+    /** Test whether the transactions of a package can be appended to the template */
+    bool TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package, const CCoinsViewCache& view) const;
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -2213,6 +2213,67 @@ void CConnman::SetNetworkActive(bool active)
     uiInterface.NotifyNetworkActiveChanged(fNetworkActive);
 }
 
+CLatencyHistogram::CLatencyHistogram() : nCount(0), nTotal(0), nMax(0)
+{
+    for (int i = 0; i < BUCKET_COUNT; i++)
+        buckets[i] = 0;
+}
+
+int CLatencyHistogram::BucketIndex(int64_t nMicros)
+{
+    if (nMicros < 4)
+        return nMicros < 0 ? 0 : nMicros;
+    uint64_t v = std::min<uint64_t>(nMicros, (uint64_t{1} << MAX_BITS) - 1);
+    int nExp = CountBits(v) - 1;
+    // The two bits below the leading one pick the linear sub-bucket
+    return 4 * (nExp - 1) + ((v >> (nExp - 2)) & 3);
+}
+
+int64_t CLatencyHistogram::BucketLowerBound(int nBucket)
+{
+    if (nBucket < 4)
+        return nBucket;
+    int nExp = nBucket / 4 + 1;
+    return (int64_t)(4 + nBucket % 4) << (nExp - 2);
+}
+
+int64_t CLatencyHistogram::BucketUpperBound(int nBucket)
+{
+    if (nBucket < 4)
+        return nBucket + 1;
+    int nExp = nBucket / 4 + 1;
+    return (int64_t)(5 + nBucket % 4) << (nExp - 2);
+}
+
+void CLatencyHistogram::Add(int64_t nMicros)
+{
+    if (nMicros < 0)
+        nMicros = 0;
+    buckets[BucketIndex(nMicros)].fetch_add(1, std::memory_order_relaxed);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    nTotal.fetch_add(nMicros, std::memory_order_relaxed);
+    uint64_t nPrevMax = nMax.load(std::memory_order_relaxed);
+    while ((uint64_t)nMicros > nPrevMax && !nMax.compare_exchange_weak(nPrevMax, nMicros, std::memory_order_relaxed)) {}
+}
+
+int64_t CLatencyHistogram::GetQuantile(double q) const
+{
+    uint64_t nSeen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        nSeen += GetBucket(i);
+    }
+    if (nSeen == 0)
+        return 0;
+    uint64_t nTarget = std::max<uint64_t>(1, std::ceil(q * nSeen));
+    uint64_t nCumulative = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        nCumulative += GetBucket(i);
+        if (nCumulative >= nTarget)
+            return BucketUpperBound(i);
+    }
+    return BucketUpperBound(BUCKET_COUNT - 1);
+}
+
 CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSeed1(nSeed1In)
 {
     fNetworkActive = true;
@@ -2225,6 +2286,10 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     semAddnode = nullptr;
     flagInterruptMsgProc = false;
 
+    for (const std::string &msg : getAllNetMessageTypes())
+        mapMsgProfile[msg];
+    mapMsgProfile[NET_MESSAGE_COMMAND_OTHER];
+
     Options connOptions;
     Init(connOptions);
 }
@@ -2585,6 +2650,33 @@ void CConnman::RecordBytesRecv(uint64_t bytes)
     nTotalBytesRecv += bytes;
 }
 
+void CConnman::RecordMessageProfile(const std::string& strCommand, int64_t nQueueMicros, int64_t nProcessMicros)
+{
+    // No lock needed: the map's keys never change after construction and
+    // the histograms are atomic.
+    mapMsgCmdProfile::iterator it = mapMsgProfile.find(strCommand);
+    if (it == mapMsgProfile.end())
+        it = mapMsgProfile.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(it != mapMsgProfile.end());
+    it->second.queue.Add(nQueueMicros);
+    it->second.process.Add(nProcessMicros);
+}
+
+void CConnman::GetProcessQueueStats(size_t& nMessages, size_t& nBytes, size_t& nMaxPeerMessages)
+{
+    nMessages = 0;
+    nBytes = 0;
+    nMaxPeerMessages = 0;
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        LOCK(pnode->cs_vProcessMsg);
+        size_t nPeerMessages = pnode->vProcessMsg.size();
+        nMessages += nPeerMessages;
+        nBytes += pnode->nProcessQueueSize;
+        nMaxPeerMessages = std::max(nMaxPeerMessages, nPeerMessages);
+    }
+}
+
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
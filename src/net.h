@@ -114,6 +114,57 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * Latency histogram over microseconds with log-linear buckets: values below
+ * 4us get a bucket each, above that every power of two is split into four
+ * equally wide buckets. All counters are relaxed atomics, so recording is
+ * cheap and never blocks; readers may see a snapshot that is off by the
+ * samples being recorded concurrently.
+ */
+class CLatencyHistogram
+{
+public:
+    //! Values are clamped below 2^MAX_BITS microseconds (about 12.7 days)
+    static const int MAX_BITS = 40;
+    static const int BUCKET_COUNT = 4 * (MAX_BITS - 1);
+
+    CLatencyHistogram();
+    CLatencyHistogram(const CLatencyHistogram&) = delete;
+    CLatencyHistogram& operator=(const CLatencyHistogram&) = delete;
+
+    void Add(int64_t nMicros);
+
+    uint64_t GetCount() const { return nCount.load(std::memory_order_relaxed); }
+    uint64_t GetTotal() const { return nTotal.load(std::memory_order_relaxed); }
+    uint64_t GetMax() const { return nMax.load(std::memory_order_relaxed); }
+    uint64_t GetBucket(int nBucket) const { return buckets[nBucket].load(std::memory_order_relaxed); }
+
+    //! Upper bound of the bucket containing the q-th quantile (0 <= q <= 1)
+    int64_t GetQuantile(double q) const;
+
+    static int BucketIndex(int64_t nMicros);
+    static int64_t BucketLowerBound(int nBucket);
+    //! Exclusive
+    static int64_t BucketUpperBound(int nBucket);
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nTotal;
+    std::atomic<uint64_t> nMax;
+};
+
+/** Message handling profile for one P2P command, see getnetprofile */
+struct CNetMsgProfile
+{
+    //! Time spent in ProcessMessage
+    CLatencyHistogram process;
+    //! Time from receipt until ProcessMessage started (waiting in vRecvMsg/vProcessMsg)
+    CLatencyHistogram queue;
+};
+//! Keyed like mapMsgCmdSize; the set of keys is fixed at construction
+typedef std::map<std::string, CNetMsgProfile> mapMsgCmdProfile;
+
 class NetEventsInterface;
 class CConnman
 {
@@ -287,6 +338,12 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    //! Record how long a message waited to be processed and how long processing took
+    void RecordMessageProfile(const std::string& strCommand, int64_t nQueueMicros, int64_t nProcessMicros);
+    const mapMsgCmdProfile& GetMessageProfile() const { return mapMsgProfile; }
+    //! Messages and bytes currently waiting in peers' process queues
+    void GetProcessQueueStats(size_t& nMessages, size_t& nBytes, size_t& nMaxPeerMessages);
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -355,6 +412,9 @@ private:
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
 
+    // Per-command processing latency, see RecordMessageProfile
+    mapMsgCmdProfile mapMsgProfile;
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
     uint64_t nMaxOutboundCycleStartTime;
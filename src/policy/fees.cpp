@@ -79,18 +79,28 @@ private:
     const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
     const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // Number of buckets all per-bucket vectors are sized for. Equal to
+    // buckets.size(), except while Read is replacing the buckets.
+    size_t nBuckets;
+
+    // Number of periods of Y blocks tracked by confAvg and failAvg
+    size_t nPeriods;
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
 
+    // The two-dimensional averages below are stored flat, one row of
+    // nBuckets per period, so that decaying them is a single linear pass.
+
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * nBuckets + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * nBuckets + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -107,12 +117,18 @@ private:
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    std::vector<int> unconfTxs;  //unconfTxs[Y * nBuckets + X]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Read one of the period-by-bucket averages, stored nested on disk, into flat storage */
+    void ReadAverages(CAutoFile& filein, std::vector<double>& vFlat, size_t& nRows, size_t numBuckets) const;
+    /** Write one of the flat period-by-bucket averages in the nested on-disk layout */
+    template <typename Stream>
+    void WriteAverages(Stream& fileout, const std::vector<double>& vFlat) const;
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -162,10 +178,11 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * nPeriods; }
 
     /** Write state of estimation data to a file*/
-    void Write(CAutoFile& fileout) const;
+    template <typename Stream>
+    void Write(Stream& fileout) const;
 
     /**
      * Read saved state of estimation data from a file and replace all internal data structures and
@@ -183,36 +200,30 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     decay = _decay;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    nBuckets = buckets.size();
+    nPeriods = maxPeriods;
+    confAvg.resize(nPeriods * nBuckets);
+    failAvg.resize(nPeriods * nBuckets);
 
-    txCtAvg.resize(buckets.size());
-    avg.resize(buckets.size());
+    txCtAvg.resize(nBuckets);
+    avg.resize(nBuckets);
 
-    resizeInMemoryCounters(buckets.size());
+    resizeInMemoryCounters(nBuckets);
 }
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
+    unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
     oldUnconfTxs.resize(newbuckets);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+    int* row = &unconfTxs[(nBlockHeight % GetMaxConfirms()) * nBuckets];
+    for (unsigned int j = 0; j < nBuckets; j++) {
+        oldUnconfTxs[j] += row[j];
+        row[j] = 0;
     }
 }
 
@@ -224,8 +235,8 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    for (size_t i = periodsToConfirm; i <= nPeriods; i++) {
+        confAvg[(i - 1) * nBuckets + bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     avg[bucketindex] += val;
@@ -233,11 +244,12 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
+    // Plain contiguous loops, which the compiler can vectorize
+    for (double& val : confAvg)
+        val *= decay;
+    for (double& val : failAvg)
+        val *= decay;
+    for (unsigned int j = 0; j < nBuckets; j++) {
         avg[j] = avg[j] * decay;
         txCtAvg[j] = txCtAvg[j] * decay;
     }
@@ -255,7 +267,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     double failNum = 0; // Number of tx's that were never confirmed but removed from the mempool after confTarget
     int periodTarget = (confTarget + scale - 1)/scale;
 
-    int maxbucketindex = buckets.size() - 1;
+    int maxbucketindex = nBuckets - 1;
 
     // requireGreater means we are looking for the lowest feerate such that all higher
     // values pass, so we start at maxbucketindex (highest feerate) and look at successively
@@ -275,7 +287,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    unsigned int bins = GetMaxConfirms();
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -288,11 +300,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += confAvg[(periodTarget - 1) * nBuckets + bucket];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        failNum += failAvg[(periodTarget - 1) * nBuckets + bucket];
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+            extraNum += unconfTxs[((nBlockHeight - confct)%bins) * nBuckets + bucket];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -396,14 +408,43 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
-void TxConfirmStats::Write(CAutoFile& fileout) const
+template <typename Stream>
+void TxConfirmStats::WriteAverages(Stream& fileout, const std::vector<double>& vFlat) const
+{
+    // Same bytes as serializing a std::vector<std::vector<double>>
+    const size_t nRows = nBuckets ? vFlat.size() / nBuckets : 0;
+    WriteCompactSize(fileout, nRows);
+    for (size_t i = 0; i < nRows; i++) {
+        WriteCompactSize(fileout, nBuckets);
+        for (size_t j = 0; j < nBuckets; j++)
+            fileout << vFlat[i * nBuckets + j];
+    }
+}
+
+void TxConfirmStats::ReadAverages(CAutoFile& filein, std::vector<double>& vFlat, size_t& nRows, size_t numBuckets) const
+{
+    std::vector<std::vector<double>> vNested;
+    filein >> vNested;
+    nRows = vNested.size();
+    vFlat.clear();
+    vFlat.reserve(nRows * numBuckets);
+    for (const std::vector<double>& row : vNested) {
+        if (row.size() != numBuckets) {
+            throw std::runtime_error("Corrupt estimates file. Mismatch in one of the average bucket counts");
+        }
+        vFlat.insert(vFlat.end(), row.begin(), row.end());
+    }
+}
+
+template <typename Stream>
+void TxConfirmStats::Write(Stream& fileout) const
 {
     fileout << decay;
     fileout << scale;
     fileout << avg;
     fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    WriteAverages(fileout, confAvg);
+    WriteAverages(fileout, failAvg);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -433,35 +474,24 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    ReadAverages(filein, confAvg, maxPeriods, numBuckets);
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
-            throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
-        }
-    }
 
     if (nFileVersion >= 149900) {
-        filein >> failAvg;
-        if (maxPeriods != failAvg.size()) {
+        size_t failPeriods;
+        ReadAverages(filein, failAvg, failPeriods, numBuckets);
+        if (maxPeriods != failPeriods) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
         }
-        for (unsigned int i = 0; i < maxPeriods; i++) {
-            if (failAvg[i].size() != numBuckets) {
-                throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
-            }
-        }
     } else {
-        failAvg.resize(confAvg.size());
-        for (unsigned int i = 0; i < failAvg.size(); i++) {
-            failAvg[i].resize(numBuckets);
-        }
+        failAvg.assign(maxPeriods * numBuckets, 0);
     }
+    nPeriods = maxPeriods;
+    nBuckets = numBuckets;
 
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
@@ -474,8 +504,8 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int blockIndex = nBlockHeight % GetMaxConfirms();
+    unconfTxs[blockIndex * nBuckets + bucketindex]++;
     return bucketindex;
 }
 
@@ -490,7 +520,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    if (blocksAgo >= (int)GetMaxConfirms()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -499,9 +529,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % GetMaxConfirms();
+        if (unconfTxs[blockIndex * nBuckets + bucketindex] > 0) {
+            unconfTxs[blockIndex * nBuckets + bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -510,8 +540,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < nPeriods; i++) {
+            failAvg[i * nBuckets + bucketindex]++;
         }
     }
 }
@@ -911,23 +941,43 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 }
 
 
+template <typename Stream>
+void CBlockPolicyEstimator::WriteData(Stream& fileout) const
+{
+    AssertLockHeld(cs_feeEstimator);
+    fileout << 149900; // version required to read: 0.14.99 or later
+    fileout << CLIENT_VERSION; // version that wrote the file
+    fileout << nBestSeenHeight;
+    if (BlockSpan() > HistoricalBlockSpan()/2) {
+        fileout << firstRecordedHeight << nBestSeenHeight;
+    }
+    else {
+        fileout << historicalFirst << historicalBest;
+    }
+    fileout << buckets;
+    feeStats->Write(fileout);
+    shortStats->Write(fileout);
+    longStats->Write(fileout);
+}
+
+bool CBlockPolicyEstimator::Write(CDataStream& stream) const
+{
+    try {
+        LOCK(cs_feeEstimator);
+        WriteData(stream);
+    }
+    catch (const std::exception&) {
+        LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
+        return false;
+    }
+    return true;
+}
+
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
     try {
         LOCK(cs_feeEstimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
-        fileout << CLIENT_VERSION; // version that wrote the file
-        fileout << nBestSeenHeight;
-        if (BlockSpan() > HistoricalBlockSpan()/2) {
-            fileout << firstRecordedHeight << nBestSeenHeight;
-        }
-        else {
-            fileout << historicalFirst << historicalBest;
-        }
-        fileout << buckets;
-        feeStats->Write(fileout);
-        shortStats->Write(fileout);
-        longStats->Write(fileout);
+        WriteData(fileout);
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -17,6 +17,7 @@
 #include <vector>
 
 class CAutoFile;
+class CDataStream;
 class CFeeRate;
 class CTxMemPoolEntry;
 class CTxMemPool;
@@ -220,6 +221,9 @@ public:
     /** Write estimation data to a file */
     bool Write(CAutoFile& fileout) const;
 
+    /** Write estimation data to memory, to be saved without holding the estimator lock */
+    bool Write(CDataStream& stream) const;
+
     /** Read estimation data from a file */
     bool Read(CAutoFile& filein);
 
@@ -258,6 +262,10 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** Serialize the estimation data, shared by both Write overloads */
+    template <typename Stream>
+    void WriteData(Stream& fileout) const;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
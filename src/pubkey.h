@@ -36,6 +36,15 @@ public:
 
 typedef uint256 ChainCode;
 
+/**
+ * A public key in the parsed form used by signature verification, so that
+ * a key checked against many signatures only has to be decompressed once.
+ */
+struct CParsedPubKey
+{
+    unsigned char data[64];
+};
+
 /** An encapsulated public key. */
 class CPubKey
 {
@@ -176,6 +185,12 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    //! Parse this public key for repeated verification. Returns false if it is not fully valid.
+    bool Parse(CParsedPubKey& parsed) const;
+
+    //! Verify a DER signature against this public key, as previously parsed by Parse().
+    static bool Verify(const CParsedPubKey& parsed, const uint256& hash, const std::vector<unsigned char>& vchSig);
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
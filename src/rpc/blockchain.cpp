@@ -1374,6 +1374,76 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getmempoolfeehistogram(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getmempoolfeehistogram ( nblocks )\n"
+            "\nReturns the feerate needed to be mined within each of the next nblocks blocks, judged by\n"
+            "the ancestor feerate order of the mempool, and the cumulative size checkpoints it is read from.\n"
+            "The mempool keeps the checkpoints up to date per ancestor feerate bucket, so feerates are\n"
+            "rounded down to a bucket boundary.\n"
+            "\nArguments:\n"
+            "1. nblocks     (numeric, optional, default=10) Number of blocks to report feerates for\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": [             (array) One entry per block\n"
+            "    {\n"
+            "      \"blocks\": n,        (numeric) Number of blocks\n"
+            "      \"depth\": n,         (numeric) Virtual bytes those blocks can hold\n"
+            "      \"feerate\": x.x      (numeric) Ancestor feerate at which that depth is reached in " + CURRENCY_UNIT + "/kB, 0 if the whole mempool fits\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"histogram\": [          (array) Checkpoints along the ancestor feerate order\n"
+            "    {\n"
+            "      \"feerate\": x.x,     (numeric) Ancestor feerate bucket boundary in " + CURRENCY_UNIT + "/kB\n"
+            "      \"size\": n,          (numeric) Virtual size of the transactions with at least this ancestor feerate\n"
+            "      \"count\": n          (numeric) Number of transactions with at least this ancestor feerate\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmempoolfeehistogram", "6")
+            + HelpExampleRpc("getmempoolfeehistogram", "6")
+        );
+
+    int nBlocks = 10;
+    if (!request.params[0].isNull())
+        nBlocks = request.params[0].get_int();
+    if (nBlocks < 1 || nBlocks > 1000)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "nblocks must be between 1 and 1000");
+
+    // Same limit the block assembler applies
+    const uint64_t nBlockMaxWeight = std::max<uint64_t>(4000, std::min<uint64_t>(MAX_BLOCK_WEIGHT - 4000, gArgs.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT)));
+    const uint64_t nBlockVsize = nBlockMaxWeight / WITNESS_SCALE_FACTOR;
+
+    // Answer everything from one snapshot, so both sections describe the same mempool
+    const std::vector<MempoolFeeCheckpoint> vCheckpoints = mempool.GetFeeCheckpoints();
+
+    UniValue blocks(UniValue::VARR);
+    for (int i = 1; i <= nBlocks; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("blocks", i));
+        entry.push_back(Pair("depth", (int64_t)(i * nBlockVsize)));
+        entry.push_back(Pair("feerate", ValueFromAmount(CTxMemPool::FeeRateAtDepth(vCheckpoints, i * nBlockVsize).GetFeePerK())));
+        blocks.push_back(entry);
+    }
+
+    UniValue histogram(UniValue::VARR);
+    for (const MempoolFeeCheckpoint& checkpoint : vCheckpoints) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("feerate", ValueFromAmount(checkpoint.feeRate.GetFeePerK())));
+        entry.push_back(Pair("size", (int64_t)checkpoint.nSize));
+        entry.push_back(Pair("count", (int64_t)checkpoint.nCount));
+        histogram.push_back(entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blocks", blocks));
+    ret.push_back(Pair("histogram", histogram));
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1601,6 +1671,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
+    { "blockchain",         "getmempoolfeehistogram", &getmempoolfeehistogram, {"nblocks"} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
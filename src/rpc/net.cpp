@@ -393,6 +393,94 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+static UniValue LatencyHistogramToJSON(const CLatencyHistogram& hist)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("total_us", hist.GetTotal()));
+    obj.push_back(Pair("max_us", hist.GetMax()));
+    obj.push_back(Pair("p50_us", hist.GetQuantile(0.5)));
+    obj.push_back(Pair("p90_us", hist.GetQuantile(0.9)));
+    obj.push_back(Pair("p99_us", hist.GetQuantile(0.99)));
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < CLatencyHistogram::BUCKET_COUNT; i++) {
+        uint64_t nBucket = hist.GetBucket(i);
+        if (nBucket == 0)
+            continue;
+        UniValue bucket(UniValue::VARR);
+        bucket.push_back(CLatencyHistogram::BucketLowerBound(i));
+        bucket.push_back(nBucket);
+        buckets.push_back(bucket);
+    }
+    obj.push_back(Pair("histogram", buckets));
+    return obj;
+}
+
+UniValue getnetprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getnetprofile\n"
+            "\nReturns per-command P2P message handling latency and the current depth of\n"
+            "the peers' message processing queues. Latencies are in microseconds and\n"
+            "percentiles are upper bounds of log-linear histogram buckets.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queue\":\n"
+            "  {\n"
+            "    \"messages\": n,          (numeric) Messages waiting to be processed, all peers\n"
+            "    \"bytes\": n,             (numeric) Bytes waiting to be processed, all peers\n"
+            "    \"max_peer_messages\": n  (numeric) Largest number of waiting messages for one peer\n"
+            "  },\n"
+            "  \"commands\":               (json object) Only commands received at least once\n"
+            "  {\n"
+            "    \"command\":\n"
+            "    {\n"
+            "      \"count\": n,           (numeric) Messages processed\n"
+            "      \"process\":            (json object) Time spent processing the message\n"
+            "      {\n"
+            "        \"total_us\": n,      (numeric) Sum of all samples\n"
+            "        \"max_us\": n,        (numeric) Largest sample\n"
+            "        \"p50_us\": n,        (numeric) Median\n"
+            "        \"p90_us\": n,        (numeric) 90th percentile\n"
+            "        \"p99_us\": n,        (numeric) 99th percentile\n"
+            "        \"histogram\": [[lower_us, count], ...]  (array) Non-empty buckets\n"
+            "      },\n"
+            "      \"queue\": {...}        (json object) Time from receipt until processing started, as above\n"
+            "    },\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetprofile", "")
+            + HelpExampleRpc("getnetprofile", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue obj(UniValue::VOBJ);
+
+    size_t nMessages, nBytes, nMaxPeerMessages;
+    g_connman->GetProcessQueueStats(nMessages, nBytes, nMaxPeerMessages);
+    UniValue queue(UniValue::VOBJ);
+    queue.push_back(Pair("messages", (uint64_t)nMessages));
+    queue.push_back(Pair("bytes", (uint64_t)nBytes));
+    queue.push_back(Pair("max_peer_messages", (uint64_t)nMaxPeerMessages));
+    obj.push_back(Pair("queue", queue));
+
+    UniValue commands(UniValue::VOBJ);
+    for (const mapMsgCmdProfile::value_type& i : g_connman->GetMessageProfile()) {
+        if (i.second.process.GetCount() == 0)
+            continue;
+        UniValue command(UniValue::VOBJ);
+        command.push_back(Pair("count", i.second.process.GetCount()));
+        command.push_back(Pair("process", LatencyHistogramToJSON(i.second.process)));
+        command.push_back(Pair("queue", LatencyHistogramToJSON(i.second.queue)));
+        commands.push_back(Pair(i.first, command));
+    }
+    obj.push_back(Pair("commands", commands));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -635,6 +723,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getnetprofile",          &getnetprofile,          {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
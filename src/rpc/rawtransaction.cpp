@@ -968,6 +968,122 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits several raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "Transactions may spend outputs of each other and may be given in any order.\n"
+            "All of them are checked under a single lock, parents before children, and\n"
+            "the accepted ones are announced to peers together.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions, at most " + std::to_string(MAX_MEMPOOL_BATCH_SIZE) + "\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (json array) One entry per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",   (string) The transaction hash in hex\n"
+            "    \"error\" : \"text\"   (string, optional) Why the transaction was not accepted\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    ObserveSafeMode();
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    // parse all hex strings before touching the mempool
+    const UniValue& hexstrings = request.params[0].get_array();
+    if (hexstrings.size() > MAX_MEMPOOL_BATCH_SIZE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions, at most %u per call", MAX_MEMPOOL_BATCH_SIZE));
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexstrings.size());
+    for (unsigned int i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %d", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Weed out transactions already confirmed or already in the mempool
+    std::vector<std::string> vError(vtx.size());
+    std::vector<bool> vfRelay(vtx.size(), false);
+    std::vector<CTransactionRef> vtxSubmit;
+    std::vector<size_t> vSubmitIndex;
+    { // cs_main scope
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[i]->vout.size(); o++) {
+                const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+            if (fHaveChain) {
+                vError[i] = "transaction already in block chain";
+            } else if (mempool.exists(hashTx)) {
+                vfRelay[i] = true;
+            } else {
+                vtxSubmit.push_back(vtx[i]);
+                vSubmitIndex.push_back(i);
+            }
+        }
+    }
+
+    // push to local node and sync with wallets
+    std::vector<CValidationState> vState;
+    std::vector<bool> vfMissingInputs;
+    std::vector<bool> vfAccepted = AcceptToMemoryPoolBatch(mempool, vtxSubmit, vState, vfMissingInputs, nMaxRawTxFee);
+    for (size_t j = 0; j < vtxSubmit.size(); j++) {
+        const size_t i = vSubmitIndex[j];
+        if (vfAccepted[j]) {
+            vfRelay[i] = true;
+        } else if (vState[j].IsInvalid()) {
+            vError[i] = strprintf("%i: %s", vState[j].GetRejectCode(), vState[j].GetRejectReason());
+        } else if (vfMissingInputs[j]) {
+            vError[i] = "Missing inputs";
+        } else {
+            vError[i] = vState[j].GetRejectReason();
+        }
+    }
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    std::vector<CInv> vInv;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vfRelay[i])
+            vInv.push_back(CInv(MSG_TX, vtx[i]->GetHash()));
+    }
+    if (!vInv.empty()) {
+        g_connman->ForEachNode([&vInv](CNode* pnode)
+        {
+            for (const CInv& inv : vInv)
+                pnode->PushInventory(inv);
+        });
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", vtx[i]->GetHash().GetHex()));
+        if (!vfRelay[i])
+            entry.push_back(Pair("error", vError[i]));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -976,6 +1092,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring"} },
     { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
@@ -12,6 +12,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 typedef std::vector<unsigned char> valtype;
@@ -62,6 +63,16 @@ static inline void popstack(std::vector<valtype>& stack)
     stack.pop_back();
 }
 
+/** Replace the top stack element by a boolean, reusing its buffer. */
+static inline void settop(std::vector<valtype>& stack, bool fValue)
+{
+    valtype& vch = stacktop(-1);
+    if (fValue)
+        vch.assign(1, 1);
+    else
+        vch.clear();
+}
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
@@ -250,9 +261,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     static const CScriptNum bnOne(1);
     // static const CScriptNum bnFalse(0);
     // static const CScriptNum bnTrue(1);
-    static const valtype vchFalse(0);
     // static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
@@ -502,7 +511,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    altstack.push_back(stacktop(-1));
+                    altstack.push_back(std::move(stacktop(-1)));
                     popstack(stack);
                 }
                 break;
@@ -511,7 +520,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (altstack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_ALTSTACK_OPERATION);
-                    stack.push_back(altstacktop(-1));
+                    stack.push_back(std::move(altstacktop(-1)));
                     popstack(altstack);
                 }
                 break;
@@ -533,8 +542,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch1 = stacktop(-2);
                     valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -546,9 +555,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     valtype vch1 = stacktop(-3);
                     valtype vch2 = stacktop(-2);
                     valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
+                    stack.push_back(std::move(vch3));
                 }
                 break;
 
@@ -559,8 +568,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch1 = stacktop(-4);
                     valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -569,11 +578,11 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    valtype vch1 = std::move(stacktop(-6));
+                    valtype vch2 = std::move(stacktop(-5));
                     stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -592,9 +601,10 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1))) {
+                        valtype vch = stacktop(-1);
+                        stack.push_back(std::move(vch));
+                    }
                 }
                 break;
 
@@ -621,7 +631,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    stack.push_back(std::move(vch));
                 }
                 break;
 
@@ -640,7 +650,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    stack.push_back(std::move(vch));
                 }
                 break;
 
@@ -655,10 +665,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
-                    if (opcode == OP_ROLL)
+                    valtype vch;
+                    if (opcode == OP_ROLL) {
+                        vch.swap(stacktop(-n-1));
                         stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                    } else {
+                        vch = stacktop(-n-1);
+                    }
+                    stack.push_back(std::move(vch));
                 }
                 break;
 
@@ -689,7 +703,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    stack.insert(stack.end()-2, std::move(vch));
                 }
                 break;
 
@@ -724,8 +738,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     //if (opcode == OP_NOTEQUAL)
                     //    fEqual = !fEqual;
                     popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fEqual ? vchTrue : vchFalse);
+                    settop(stack, fEqual);
                     if (opcode == OP_EQUALVERIFY)
                     {
                         if (fEqual)
@@ -834,8 +847,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     bool fValue = (bn2 <= bn1 && bn1 < bn3);
                     popstack(stack);
                     popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fValue ? vchTrue : vchFalse);
+                    settop(stack, fValue);
                 }
                 break;
 
@@ -853,19 +865,20 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    unsigned char vchHash[32];
+                    size_t nHashSize = (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CSHA1().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CSHA256().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CHash160().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                        CHash256().Write(vch.data(), vch.size()).Finalize(vchHash);
+                    // Overwrite the preimage in place, reusing its buffer
+                    vch.assign(vchHash, vchHash + nHashSize);
                 }
                 break;                                   
 
@@ -904,8 +917,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
 
                     popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    settop(stack, fSuccess);
                     if (opcode == OP_CHECKSIGVERIFY)
                     {
                         if (fSuccess)
@@ -1010,9 +1022,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stacktop(-1).size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
-                    popstack(stack);
-
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    settop(stack, fSuccess);
 
                     if (opcode == OP_CHECKMULTISIGVERIFY)
                     {
@@ -1165,9 +1175,59 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
     return ss.GetHash();
 }
 
+/** Size of an input serialized with an empty script: prevout, script length, nSequence. */
+const size_t LEGACY_BLANK_INPUT_SIZE = 36 + 1 + 4;
+
+/** Whether any input looks like a legacy (non-witness) spend that signs with SignatureHash. */
+bool HasLegacySpend(const CTransaction& txTo)
+{
+    for (const auto& txin : txTo.vin) {
+        if (!txin.scriptSig.empty() && txin.scriptWitness.IsNull()) return true;
+    }
+    return false;
+}
+
+/** Append every push in script that could be a public key to vKeys. */
+void CollectPubKeys(const CScript& script, std::vector<CPubKey>& vKeys)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vchPush;
+    while (pc < script.end() && script.GetOp(pc, opcode, vchPush)) {
+        if (vchPush.size() == 33 || vchPush.size() == 65) {
+            CPubKey pubkey(vchPush);
+            if (pubkey.IsValid()) vKeys.push_back(pubkey);
+        }
+    }
+}
+
+/** Keys of a scriptSig: its own pushes, and those of a P2SH redeemScript. */
+void CollectPubKeys(const CTxIn& txin, std::vector<CPubKey>& vKeys)
+{
+    CollectPubKeys(txin.scriptSig, vKeys);
+    CScript::const_iterator pc = txin.scriptSig.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vchPush, vchLast;
+    while (pc < txin.scriptSig.end() && txin.scriptSig.GetOp(pc, opcode, vchPush))
+        vchLast.swap(vchPush);
+    if (!vchLast.empty()) CollectPubKeys(CScript(vchLast.begin(), vchLast.end()), vKeys);
+
+    const auto& stack = txin.scriptWitness.stack;
+    for (const auto& item : stack) {
+        CPubKey pubkey(item);
+        if (pubkey.IsValid()) vKeys.push_back(pubkey);
+    }
+    if (!stack.empty()) CollectPubKeys(CScript(stack.back().begin(), stack.back().end()), vKeys);
+}
+
 } // namespace
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+{
+    Init(txTo);
+}
+
+void PrecomputedTransactionData::Init(const CTransaction& txTo)
 {
     // Cache is calculated only for transactions with witness
     if (txTo.HasWitness()) {
@@ -1176,6 +1236,71 @@ PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
         hashOutputs = GetOutputsHash(txTo);
         ready = true;
     }
+
+    // The lazy caches only pay off once several inputs share them. They are
+    // left until a signature is checked, which a script cache hit avoids.
+    if (txTo.vin.size() > 1)
+        lazy.reset(new LazyData());
+}
+
+const PrecomputedTransactionData::LegacyCache* PrecomputedTransactionData::GetLegacyCache(const CTransaction& txTo) const
+{
+    if (!lazy) return nullptr;
+    std::call_once(lazy->legacyOnce, [this, &txTo]() {
+        if (!HasLegacySpend(txTo)) return;
+        LegacyCache& legacy = lazy->legacy;
+
+        CVectorWriter inputs(SER_GETHASH, 0, legacy.inputs, 0);
+        for (const auto& txin : txTo.vin) {
+            inputs << txin.prevout << CScript() << txin.nSequence;
+        }
+        assert(legacy.inputs.size() == LEGACY_BLANK_INPUT_SIZE * txTo.vin.size());
+
+        CVectorWriter outputs(SER_GETHASH, 0, legacy.outputs, 0);
+        outputs << txTo.vout << txTo.nLockTime;
+
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << txTo.nVersion;
+        ::WriteCompactSize(ss, txTo.vin.size());
+        legacy.midstates.reserve(txTo.vin.size());
+        for (size_t i = 0; i < txTo.vin.size(); i++) {
+            legacy.midstates.push_back(ss);
+            ss.write((const char*)&legacy.inputs[LEGACY_BLANK_INPUT_SIZE * i], LEGACY_BLANK_INPUT_SIZE);
+        }
+        lazy->legacyReady = true;
+    });
+    return lazy->legacyReady ? &lazy->legacy : nullptr;
+}
+
+const CParsedPubKey* PrecomputedTransactionData::FindParsedKey(const CTransaction& txTo, const CPubKey& pubkey) const
+{
+    if (!lazy) return nullptr;
+    // A key checked by several signatures (a consolidation of outputs to the
+    // same address, or inputs of the same multisig) is only parsed once.
+    std::call_once(lazy->keysOnce, [this, &txTo]() {
+        std::vector<CPubKey> vKeys;
+        for (const auto& txin : txTo.vin) {
+            CollectPubKeys(txin, vKeys);
+        }
+        std::sort(vKeys.begin(), vKeys.end());
+        std::vector<CPubKey> vRepeated;
+        for (size_t i = 0; i + 1 < vKeys.size(); i++) {
+            if (vKeys[i] == vKeys[i + 1] && (vRepeated.empty() || vRepeated.back() != vKeys[i]))
+                vRepeated.push_back(vKeys[i]);
+        }
+        lazy->keys.reset(new ParsedKey[vRepeated.size()]);
+        lazy->nKeys = vRepeated.size();
+        for (size_t i = 0; i < vRepeated.size(); i++)
+            lazy->keys[i].pubkey = vRepeated[i];
+    });
+
+    ParsedKey* const begin = lazy->keys.get();
+    ParsedKey* const end = begin + lazy->nKeys;
+    ParsedKey* it = std::lower_bound(begin, end, pubkey,
+        [](const ParsedKey& a, const CPubKey& b) { return a.pubkey < b; });
+    if (it == end || it->pubkey != pubkey) return nullptr;
+    std::call_once(it->once, [it]() { it->valid = it->pubkey.Parse(it->parsed); });
+    return it->valid ? &it->parsed : nullptr;
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1241,6 +1366,31 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL (with or without ANYONECANPAY) only differs between inputs
+    // in the input being signed, so reuse everything else from the cache.
+    const PrecomputedTransactionData::LegacyCache* legacy = nullptr;
+    if (cache && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE)
+        legacy = cache->GetLegacyCache(txTo);
+    if (legacy) {
+        assert(legacy->midstates.size() == txTo.vin.size());
+        if (nHashType & SIGHASH_ANYONECANPAY) {
+            CHashWriter ss(SER_GETHASH, 0);
+            ss << txTo.nVersion;
+            ::WriteCompactSize(ss, 1);
+            txTmp.SerializeInput(ss, nIn);
+            ss.write((const char*)legacy->outputs.data(), legacy->outputs.size());
+            ss << nHashType;
+            return ss.GetHash();
+        }
+        CHashWriter ss(legacy->midstates[nIn]);
+        txTmp.SerializeInput(ss, nIn);
+        const size_t nAfter = LEGACY_BLANK_INPUT_SIZE * (nIn + 1);
+        ss.write((const char*)legacy->inputs.data() + nAfter, legacy->inputs.size() - nAfter);
+        ss.write((const char*)legacy->outputs.data(), legacy->outputs.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1249,6 +1399,8 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
 
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
+    const CParsedPubKey* parsed = txdata ? txdata->FindParsedKey(*txTo, pubkey) : nullptr;
+    if (parsed) return CPubKey::Verify(*parsed, sighash, vchSig);
     return pubkey.Verify(sighash, vchSig);
 }
 
@@ -1355,6 +1507,56 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
     return true;
 }
 
+/**
+ * Evaluate scriptCode, which must be OP_DUP OP_HASH160 <20 bytes>
+ * OP_EQUALVERIFY OP_CHECKSIG, on a stack of exactly <sig> <pubkey> without
+ * going through EvalScript. The checks are the ones EvalScript performs for
+ * that script, in the same order, so the result and error are identical.
+ * For SIGVERSION_BASE the caller must ensure FindAndDelete would leave
+ * scriptCode unchanged, i.e. that vchSig is not 20 bytes long.
+ */
+static bool EvalPayToPubKeyHash(const valtype& vchSig, const valtype& vchPubKey, const CScript& scriptCode, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    unsigned char hash[20];
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash);
+    if (memcmp(hash, &scriptCode[3], sizeof(hash)) != 0)
+        return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, serror)) {
+        //serror is set
+        return false;
+    }
+    bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
+        return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+    if (!fSuccess)
+        return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+/**
+ * Match a scriptSig of two direct pushes spending a pay-to-pubkeyhash
+ * scriptPubKey, in a shape for which EvalPayToPubKeyHash gives the same
+ * outcome as the generic interpreter: direct pushes of at least two bytes
+ * are always minimal, and only a 20 byte signature could be removed from
+ * the scriptCode by FindAndDelete.
+ */
+static bool MatchPayToPubKeyHashSpend(const CScript& scriptSig, const CScript& scriptPubKey, valtype& vchSig, valtype& vchPubKey)
+{
+    if (scriptPubKey.size() != 25 || scriptPubKey[0] != OP_DUP || scriptPubKey[1] != OP_HASH160 ||
+        scriptPubKey[2] != 20 || scriptPubKey[23] != OP_EQUALVERIFY || scriptPubKey[24] != OP_CHECKSIG)
+        return false;
+
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    if (!scriptSig.GetOp(pc, opcode, vchSig) || opcode < 2 || opcode >= OP_PUSHDATA1 || vchSig.size() == 20)
+        return false;
+    if (!scriptSig.GetOp(pc, opcode, vchPubKey) || opcode < 2 || opcode >= OP_PUSHDATA1)
+        return false;
+    return pc == scriptSig.end();
+}
+
 static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, const std::vector<unsigned char>& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     std::vector<std::vector<unsigned char> > stack;
@@ -1379,7 +1581,12 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH); // 2 items in witness
             }
             scriptPubKey << OP_DUP << OP_HASH160 << program << OP_EQUALVERIFY << OP_CHECKSIG;
-            stack = witness.stack;
+            for (const valtype& elem : witness.stack) {
+                if (elem.size() > MAX_SCRIPT_ELEMENT_SIZE)
+                    return set_error(serror, SCRIPT_ERR_PUSH_SIZE);
+            }
+            // The script is fixed, so skip the generic interpreter
+            return EvalPayToPubKeyHash(witness.stack[0], witness.stack[1], scriptPubKey, flags, checker, SIGVERSION_WITNESS_V0, serror);
         } else {
             return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WRONG_LENGTH);
         }
@@ -1422,11 +1629,27 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    valtype vchSig, vchPubKey;
+    if (MatchPayToPubKeyHashSpend(scriptSig, scriptPubKey, vchSig, vchPubKey)) {
+        // Standard pay-to-pubkeyhash spend: neither P2SH nor a witness program,
+        // and a successful evaluation leaves a clean stack.
+        if (!EvalPayToPubKeyHash(vchSig, vchPubKey, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
+            return false;
+        assert(!(flags & SCRIPT_VERIFY_CLEANSTACK) || (flags & SCRIPT_VERIFY_WITNESS));
+        if (flags & SCRIPT_VERIFY_WITNESS) {
+            assert((flags & SCRIPT_VERIFY_P2SH) != 0);
+            if (!witness->IsNull())
+                return set_error(serror, SCRIPT_ERR_WITNESS_UNEXPECTED);
+        }
+        return set_success(serror);
+    }
+
     std::vector<std::vector<unsigned char> > stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
+    // The copy is only needed to evaluate the redeemScript of a P2SH spend
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
         stackCopy = stack;
     if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
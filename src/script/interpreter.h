@@ -7,9 +7,13 @@
 #ifndef SUCRECOIN_SCRIPT_INTERPRETER_H
 #define SUCRECOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
+#include "pubkey.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <stdint.h>
 #include <string>
@@ -116,7 +120,65 @@ struct PrecomputedTransactionData
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * Shared pieces of the legacy SIGHASH_ALL serialization, which otherwise
+     * re-serializes the whole transaction for every input. midstates[i] has
+     * hashed everything before input i, inputs holds every input with an
+     * empty scriptSig, and outputs holds the outputs followed by nLockTime.
+     */
+    struct LegacyCache
+    {
+        std::vector<CHashWriter> midstates;
+        std::vector<unsigned char> inputs;
+        std::vector<unsigned char> outputs;
+    };
+
+    PrecomputedTransactionData() {}
     explicit PrecomputedTransactionData(const CTransaction& tx);
+
+    /** Fill in the cached data for tx; must be called at most once. */
+    void Init(const CTransaction& tx);
+
+    /**
+     * Return the legacy cache for tx, building it on first use, or nullptr
+     * if tx has a single input or no legacy spends.
+     */
+    const LegacyCache* GetLegacyCache(const CTransaction& tx) const;
+
+    /**
+     * Return the parsed form of pubkey if it appears in more than one input
+     * (or more than once in an input) of tx, or nullptr. The repeated keys
+     * are collected on the first lookup, and each is parsed on its own first
+     * lookup.
+     */
+    const CParsedPubKey* FindParsedKey(const CTransaction& tx, const CPubKey& pubkey) const;
+
+private:
+    struct ParsedKey
+    {
+        CPubKey pubkey;
+        std::once_flag once;
+        CParsedPubKey parsed;
+        bool valid = false;
+    };
+
+    /**
+     * Caches that are only built once a signature of the transaction is
+     * actually checked, which may happen on several script check threads
+     * at once.
+     */
+    struct LazyData
+    {
+        std::once_flag legacyOnce;
+        LegacyCache legacy;
+        bool legacyReady = false;
+
+        std::once_flag keysOnce;
+        /** Repeated keys, sorted */
+        std::unique_ptr<ParsedKey[]> keys;
+        size_t nKeys = 0;
+    };
+    std::unique_ptr<LazyData> lazy;
 };
 
 enum SigVersion
@@ -54,4 +54,14 @@ public:
 
 void InitSignatureCache();
 
+/** Copy out the signature cache nonce and its live entries, for persisting. */
+void DumpSignatureCache(uint256& nonce, std::vector<uint256>& entries);
+
+/**
+ * Replace the signature cache nonce and re-insert entries from a previous
+ * DumpSignatureCache. Entries computed under the old nonce become
+ * unreachable, so this must run before the cache is first used.
+ */
+void LoadSignatureCache(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // SUCRECOIN_SCRIPT_SIGCACHE_H
@@ -17,6 +17,7 @@
 
 #include "test/test_sucrecoin.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <boost/test/unit_test.hpp>
@@ -24,13 +25,15 @@
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphansUsage);
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t nUsage;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern size_t nOrphanTransactionsUsage;
 
 CService ip(uint32_t i)
 {
@@ -259,13 +262,25 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
     }
 
+    // Usage accounting tracks the entries that are left
+    size_t nUsage = 0;
+    for (const auto& entry : mapOrphanTransactions)
+        nUsage += entry.second.nUsage;
+    BOOST_CHECK_EQUAL(nOrphanTransactionsUsage, nUsage);
+
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t nNoUsageLimit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    nUsage = nOrphanTransactionsUsage;
+    LimitOrphanTxSize(40, nUsage / 2);
+    BOOST_CHECK(mapOrphanTransactions.size() > 0);
+    BOOST_CHECK(nOrphanTransactionsUsage <= nUsage / 2);
+    LimitOrphanTxSize(10, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    LimitOrphanTxSize(0, nNoUsageLimit);
     BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(nOrphanTransactionsUsage, 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include "addrman.h"
 #include "test/test_sucrecoin.h"
+#include <atomic>
 #include <string>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 
 #include "hash.h"
@@ -218,6 +220,38 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_concurrent)
+{
+    CAddrMan addrman;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    addrman.Add(CAddress(ResolveService("250.1.1.1", 2108), NODE_NONE), source);
+
+    // Test: Select keeps finding an address while another thread changes
+    //  the tables and the snapshot it reads from is republished.
+    std::atomic<bool> fDone(false);
+    std::thread adder([&] {
+        for (unsigned int i = 1; i < 256; i++) {
+            CService addr = ResolveService("251.1." + boost::to_string(i) + ".1", 2108);
+            addrman.Add(CAddress(addr, NODE_NONE), source);
+            if (i % 4 == 0)
+                addrman.Good(CAddress(addr, NODE_NONE));
+        }
+        fDone = true;
+    });
+    int nSelected = 0;
+    int nNull = 0;
+    while (!fDone) {
+        if (addrman.Select().ToString() == "[::]:0")
+            nNull++;
+        nSelected++;
+    }
+    adder.join();
+    BOOST_CHECK(nSelected > 0);
+    BOOST_CHECK_EQUAL(nNull, 0);
+    BOOST_CHECK(addrman.size() > 1);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
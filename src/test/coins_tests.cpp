@@ -856,4 +856,25 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsView base;
+    CCoinsViewCache parent(&base);
+    CCoinsViewCache cache(&parent);
+    COutPoint outpoint(InsecureRand256(), 0);
+
+    cache.PrefetchCoin(outpoint, Coin(CTxOut(VALUE1, CScript() << OP_TRUE), 1, false));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).out.nValue, VALUE1);
+
+    // An outpoint that is already cached keeps its entry
+    cache.PrefetchCoin(outpoint, Coin(CTxOut(VALUE2, CScript() << OP_TRUE), 1, false));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).out.nValue, VALUE1);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1);
+
+    // Prefetched coins are clean, so flushing writes nothing back
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(parent.GetCacheSize(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
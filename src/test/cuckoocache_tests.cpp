@@ -378,4 +378,93 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that dump returns exactly the live elements, and that re-inserting
+ * them restores a cache of the same size.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_dump_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // Erased elements are garbage and must not be carried over
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        cc.contains(hashes[i], true);
+
+    std::vector<uint256> dumped;
+    cc.dump(dumped);
+    BOOST_CHECK_EQUAL(dumped.size(), hashes.size() / 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& h : dumped)
+        restored.insert(h);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(restored.contains(hashes[i], false), i % 2 == 1);
+}
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher, CuckooCache::atomic_element_table<uint256>> atomic_cache;
+
+/** The atomic table must behave like the plain one when used single threaded */
+BOOST_AUTO_TEST_CASE(cuckoocache_atomic_table_ok)
+{
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = test_cache<atomic_cache>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(hits, load) > 0.98);
+    }
+    test_cache_erase<atomic_cache>(megabytes);
+    test_cache_erase_parallel<atomic_cache>(megabytes);
+    test_cache_generations<atomic_cache>();
+}
+
+/* Test that lookups running concurrently with inserts never find elements
+ * that were not inserted, and rarely miss ones that were.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_atomic_concurrent_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    atomic_cache set{};
+    size_t bytes = 1 << 20;
+    set.setup_bytes(bytes);
+    uint32_t n_insert = bytes / sizeof(uint256) / 4;
+    std::vector<uint256> present(n_insert), absent(n_insert), later(n_insert);
+    for (uint32_t i = 0; i < n_insert; ++i) {
+        insecure_GetRandHash(present[i]);
+        insecure_GetRandHash(absent[i]);
+        insecure_GetRandHash(later[i]);
+    }
+    for (const uint256& h : present)
+        set.insert(h);
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0), misses(0), fakes(0);
+    std::vector<std::thread> threads;
+    for (int x = 0; x < 3; ++x)
+        threads.emplace_back([&] {
+            do {
+                for (uint32_t i = 0; i < n_insert; ++i) {
+                    fakes += set.contains(absent[i], false);
+                    misses += !set.contains(present[i], false);
+                }
+                reads += n_insert;
+            } while (!done);
+        });
+    /** Inserting moves the existing elements around under the readers */
+    for (const uint256& h : later)
+        set.insert(h);
+    done = true;
+    for (std::thread& t : threads)
+        t.join();
+
+    BOOST_CHECK_EQUAL(fakes, 0);
+    BOOST_CHECK(misses * 100 < reads);
+    for (uint32_t i = 0; i < n_insert; ++i)
+        BOOST_CHECK(set.contains(later[i], false));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -118,6 +118,17 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(!pubkey2C.Verify(hashMsg, sign1C));
         BOOST_CHECK( pubkey2C.Verify(hashMsg, sign2C));
 
+        // verification against parsed keys
+
+        CParsedPubKey parsed1, parsed2C;
+        BOOST_CHECK(pubkey1.Parse(parsed1));
+        BOOST_CHECK(pubkey2C.Parse(parsed2C));
+
+        BOOST_CHECK( CPubKey::Verify(parsed1, hashMsg, sign1));
+        BOOST_CHECK(!CPubKey::Verify(parsed1, hashMsg, sign2));
+        BOOST_CHECK(!CPubKey::Verify(parsed2C, hashMsg, sign1C));
+        BOOST_CHECK( CPubKey::Verify(parsed2C, hashMsg, sign2C));
+
         // compact signatures (with key recovery)
 
         std::vector<unsigned char> csign1, csign2, csign1C, csign2C;
@@ -10,6 +10,7 @@
 #include "test/test_sucrecoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <list>
 #include <vector>
 
@@ -428,6 +429,211 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<ancestor_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolInfoForRelayTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // A low fee parent with a high fee child, and an unrelated transaction
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(50000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(2000LL).FromTx(tx3));
+
+    CMutableTransaction txMissing = tx3;
+    txMissing.vin[0].scriptSig = CScript() << OP_4;
+
+    // Parents come before children, then higher fee rate first; hashes
+    // that are not in the mempool are skipped.
+    std::vector<uint256> vtxid = {tx2.GetHash(), txMissing.GetHash(), tx1.GetHash(), tx3.GetHash()};
+    std::vector<TxMempoolInfo> vinfo = pool.infoForRelay(vtxid);
+    BOOST_REQUIRE_EQUAL(vinfo.size(), 3);
+    BOOST_CHECK(vinfo[0].tx->GetHash() == tx3.GetHash());
+    BOOST_CHECK(vinfo[1].tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK(vinfo[2].tx->GetHash() == tx2.GetHash());
+
+    BOOST_CHECK(pool.infoForRelay(std::vector<uint256>()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDiamondAncestorsTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // tx1 is reachable from tx4 through both tx2 and tx3, and must only be
+    // accounted for once
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        tx1.vout[i].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx1.vout[i].nValue = 10 * COIN;
+    }
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(2000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = tx2;
+    tx3.vin[0].prevout = COutPoint(tx1.GetHash(), 1);
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(3000LL).FromTx(tx3));
+
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(2);
+    tx4.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx4.vin[0].scriptSig = CScript() << OP_4;
+    tx4.vin[1].prevout = COutPoint(tx3.GetHash(), 0);
+    tx4.vin[1].scriptSig = CScript() << OP_4;
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_4 << OP_EQUAL;
+    tx4.vout[0].nValue = 20 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(4000LL).FromTx(tx4));
+
+    CTxMemPool::txiter it1 = pool.mapTx.find(tx1.GetHash());
+    CTxMemPool::txiter it4 = pool.mapTx.find(tx4.GetHash());
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 10000);
+    BOOST_CHECK_EQUAL(it1->GetCountWithDescendants(), 4);
+    BOOST_CHECK_EQUAL(it1->GetModFeesWithDescendants(), 10000);
+
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*it4, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3);
+    // The count limit includes the transaction itself
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*it4, setAncestors, 3, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+
+    CTxMemPool::setEntries setDescendants;
+    pool.CalculateDescendants(it1, setDescendants);
+    BOOST_CHECK_EQUAL(setDescendants.size(), 4);
+
+    // Confirming tx1 takes it out of the ancestor state of every descendant
+    std::vector<CTransactionRef> vtx = {MakeTransactionRef(tx1)};
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 9000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetCountWithAncestors(), 1);
+
+    // Links stay sorted by hash, and confirmed parents are unlinked
+    const CTxMemPool::LinkEntries& parents4 = pool.GetMemPoolParents(it4);
+    BOOST_CHECK_EQUAL(parents4.size(), 2);
+    BOOST_CHECK((*parents4.begin())->GetTx().GetHash() < (*std::next(parents4.begin()))->GetTx().GetHash());
+    BOOST_CHECK(pool.GetMemPoolParents(pool.mapTx.find(tx2.GetHash())).empty());
+}
+
+// Each checkpoint must cover exactly the entries with at least its feerate
+static void CheckFeeCheckpoints(CTxMemPool& pool)
+{
+    std::vector<MempoolFeeCheckpoint> vCheckpoints = pool.GetFeeCheckpoints();
+    for (const MempoolFeeCheckpoint& checkpoint : vCheckpoints) {
+        uint64_t nSize = 0;
+        uint64_t nCount = 0;
+        for (const CTxMemPoolEntry& e : pool.mapTx) {
+            // The first bucket also holds negative feerates from prioritisation
+            if (CFeeRate(e.GetModFeesWithAncestors(), e.GetSizeWithAncestors()) >= checkpoint.feeRate || checkpoint.feeRate == CFeeRate(0)) {
+                nSize += e.GetTxSize();
+                nCount++;
+            }
+        }
+        BOOST_CHECK_EQUAL(checkpoint.nSize, nSize);
+        BOOST_CHECK_EQUAL(checkpoint.nCount, nCount);
+        BOOST_CHECK(pool.GetFeeRateAtDepth(checkpoint.nSize) == checkpoint.feeRate);
+        BOOST_CHECK(CTxMemPool::FeeRateAtDepth(vCheckpoints, checkpoint.nSize) == checkpoint.feeRate);
+    }
+    if (!vCheckpoints.empty()) {
+        BOOST_CHECK_EQUAL(vCheckpoints.back().nSize, pool.GetTotalTxSize());
+        BOOST_CHECK_EQUAL(vCheckpoints.back().nCount, pool.size());
+    }
+    // Everything fits within a larger depth
+    BOOST_CHECK(pool.GetFeeRateAtDepth(pool.GetTotalTxSize() + 1) == CFeeRate(0));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolFeeCheckpointsTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    BOOST_CHECK(pool.GetFeeCheckpoints().empty());
+    BOOST_CHECK(pool.GetFeeRateAtDepth(1) == CFeeRate(0));
+
+    std::vector<CMutableTransaction> vtx(4);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vtx[i].vin.resize(1);
+        vtx[i].vin[0].scriptSig = CScript() << OP_11;
+        vtx[i].vin[0].prevout.n = i;
+        vtx[i].vout.resize(1);
+        vtx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vtx[i].vout[0].nValue = 10 * COIN;
+    }
+
+    // Checkpoints follow every addition, best feerate first, and round
+    // feerates down to a bucket boundary
+    for (size_t i = 0; i < 3; i++) {
+        pool.addUnchecked(vtx[i].GetHash(), entry.Fee(1000LL * (i + 1)).FromTx(vtx[i]));
+        CheckFeeCheckpoints(pool);
+    }
+    std::vector<MempoolFeeCheckpoint> vCheckpoints = pool.GetFeeCheckpoints();
+    BOOST_CHECK_EQUAL(vCheckpoints.size(), 3);
+    for (size_t i = 0; i < vCheckpoints.size(); i++) {
+        const CTxMemPoolEntry& e = *pool.mapTx.find(vtx[2 - i].GetHash());
+        CFeeRate rate(e.GetModifiedFee(), e.GetTxSize());
+        BOOST_CHECK_EQUAL(vCheckpoints[i].nCount, i + 1);
+        BOOST_CHECK(vCheckpoints[i].feeRate <= rate);
+        BOOST_CHECK(vCheckpoints[i].feeRate.GetFeePerK() * MEMPOOL_FEE_BUCKET_SPACING > rate.GetFeePerK());
+    }
+
+    // A child goes in the bucket for its ancestor feerate, which includes its parent
+    vtx[3].vin[0].prevout.hash = vtx[0].GetHash();
+    vtx[3].vin[0].prevout.n = 0;
+    pool.addUnchecked(vtx[3].GetHash(), entry.Fee(20000LL).FromTx(vtx[3]));
+    CheckFeeCheckpoints(pool);
+    BOOST_CHECK_EQUAL(pool.GetFeeCheckpoints().size(), 4);
+
+    // Prioritisation moves a transaction and its descendants between buckets, of the transaction and its descendants
+    pool.PrioritiseTransaction(vtx[1].GetHash(), 100000LL);
+    CheckFeeCheckpoints(pool);
+    BOOST_CHECK_EQUAL(pool.GetFeeCheckpoints()[0].nCount, 1);
+    pool.PrioritiseTransaction(vtx[0].GetHash(), -100000LL);
+    CheckFeeCheckpoints(pool);
+
+    // And removal, of a parent together with its child
+    pool.removeRecursive(CTransaction(vtx[0]));
+    CheckFeeCheckpoints(pool);
+    BOOST_CHECK_EQUAL(pool.GetFeeCheckpoints().back().nCount, 2);
+
+    pool.clear();
+    BOOST_CHECK(pool.GetFeeCheckpoints().empty());
+}
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
@@ -225,6 +225,114 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+// Test that BlockTemplateCache appends new mempool transactions best package
+// first, and rebuilds when a transaction in the template is removed or
+// prioritised or when a better package no longer fits.
+void TestBlockTemplateCache(const CChainParams& chainparams, CScript scriptPubKey, std::vector<CTransactionRef>& txFirst)
+{
+    BlockAssembler::Options options;
+    options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.blockMinFeeRate = blockMinFeeRate;
+    BlockTemplateCache cache(chainparams, options);
+    TestMemPoolEntryHelper entry;
+    CValidationState state;
+
+    uint64_t nSequence = 0, nSequenceLast = 0;
+    std::unique_ptr<CBlockTemplate> pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequenceLast);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+    BOOST_CHECK_EQUAL(cache.GetFeesAvailable(), 0);
+
+    // A transaction entering the mempool is appended to the cached template,
+    // and the coinbase collects its fee
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[0]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    uint256 hashParentTx = tx.GetHash();
+    mempool.addUnchecked(hashParentTx, entry.Fee(10000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+    BOOST_CHECK_EQUAL(cache.GetFeesAvailable(), 10000);
+
+    pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequence);
+    BOOST_CHECK(nSequence != nSequenceLast);
+    nSequenceLast = nSequence;
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -10000);
+
+    // So is a child whose parent is already in the template
+    tx.vin[0].prevout.hash = hashParentTx;
+    tx.vout[0].nValue -= 20000;
+    uint256 hashChildTx = tx.GetHash();
+    mempool.addUnchecked(hashChildTx, entry.Fee(20000).Time(GetTime()).SpendsCoinbase(false).FromTx(tx));
+
+    pblocktemplate = cache.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashChildTx);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -30000);
+    BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+
+    // Nothing changed, so neither does the sequence
+    pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequenceLast);
+    pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequence);
+    BOOST_CHECK_EQUAL(nSequence, nSequenceLast);
+
+    // Removing a transaction that is in the template forces a rebuild
+    mempool.removeRecursive(CTransaction(tx));
+    pblocktemplate = cache.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -10000);
+
+    // New transactions are appended best feerate first, whatever order they
+    // entered the mempool in
+    tx.vin[0].prevout.hash = txFirst[1]->GetHash();
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    uint256 hashLowFeeTx = tx.GetHash();
+    mempool.addUnchecked(hashLowFeeTx, entry.Fee(10000).SpendsCoinbase(true).FromTx(tx));
+    tx.vin[0].prevout.hash = txFirst[2]->GetHash();
+    tx.vout[0].nValue = 5000000000LL - 50000;
+    uint256 hashHighFeeTx = tx.GetHash();
+    mempool.addUnchecked(hashHighFeeTx, entry.Fee(50000).SpendsCoinbase(true).FromTx(tx));
+
+    pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequenceLast);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashHighFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == hashLowFeeTx);
+    BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+
+    // Prioritising a transaction forces a rebuild with the new feerates
+    mempool.PrioritiseTransaction(hashLowFeeTx, 100000);
+    pblocktemplate = cache.GetTemplate(scriptPubKey, true, &nSequence);
+    BOOST_CHECK(nSequence != nSequenceLast);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashLowFeeTx);
+    mempool.ClearPrioritisation(hashLowFeeTx);
+    mempool.clear();
+
+    // A package that doesn't fit the block but has a higher ancestor feerate
+    // than the template's lowest replaces the cheaper transactions
+    options.nBlockMaxWeight = 4000 + GetTransactionWeight(tx) * 3 / 2;
+    BlockTemplateCache cacheSmall(chainparams, options);
+    tx.vin[0].prevout.hash = txFirst[1]->GetHash();
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    mempool.addUnchecked(hashLowFeeTx, entry.Fee(10000).SpendsCoinbase(true).FromTx(tx));
+    pblocktemplate = cacheSmall.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashLowFeeTx);
+
+    tx.vin[0].prevout.hash = txFirst[2]->GetHash();
+    tx.vout[0].nValue = 5000000000LL - 50000;
+    mempool.addUnchecked(hashHighFeeTx, entry.Fee(50000).SpendsCoinbase(true).FromTx(tx));
+    pblocktemplate = cacheSmall.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashHighFeeTx);
+
+    mempool.clear();
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -590,6 +698,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     mempool.clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    TestBlockTemplateCache(chainparams, scriptPubKey, txFirst);
 
     fCheckpointsEnabled = true;
 }
@@ -186,4 +186,33 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(latency_histogram)
+{
+    // Buckets are contiguous and each value lands in the bucket covering it
+    for (int i = 0; i < CLatencyHistogram::BUCKET_COUNT; i++) {
+        BOOST_CHECK(CLatencyHistogram::BucketLowerBound(i) < CLatencyHistogram::BucketUpperBound(i));
+        if (i > 0)
+            BOOST_CHECK_EQUAL(CLatencyHistogram::BucketLowerBound(i), CLatencyHistogram::BucketUpperBound(i - 1));
+        BOOST_CHECK_EQUAL(CLatencyHistogram::BucketIndex(CLatencyHistogram::BucketLowerBound(i)), i);
+        BOOST_CHECK_EQUAL(CLatencyHistogram::BucketIndex(CLatencyHistogram::BucketUpperBound(i) - 1), i);
+    }
+    BOOST_CHECK_EQUAL(CLatencyHistogram::BucketIndex(-5), 0);
+    BOOST_CHECK_EQUAL(CLatencyHistogram::BucketIndex(std::numeric_limits<int64_t>::max()), CLatencyHistogram::BUCKET_COUNT - 1);
+
+    CLatencyHistogram hist;
+    BOOST_CHECK_EQUAL(hist.GetQuantile(0.5), 0);
+    for (int i = 0; i < 90; i++)
+        hist.Add(10);
+    for (int i = 0; i < 10; i++)
+        hist.Add(1000);
+    BOOST_CHECK_EQUAL(hist.GetCount(), 100);
+    BOOST_CHECK_EQUAL(hist.GetTotal(), 90 * 10 + 10 * 1000);
+    BOOST_CHECK_EQUAL(hist.GetMax(), 1000);
+    BOOST_CHECK_EQUAL(hist.GetQuantile(0.5), CLatencyHistogram::BucketUpperBound(CLatencyHistogram::BucketIndex(10)));
+    BOOST_CHECK_EQUAL(hist.GetQuantile(0.9), CLatencyHistogram::BucketUpperBound(CLatencyHistogram::BucketIndex(10)));
+    BOOST_CHECK_EQUAL(hist.GetQuantile(0.99), CLatencyHistogram::BucketUpperBound(CLatencyHistogram::BucketIndex(1000)));
+    // Log-linear: relative bucket width stays within 25%
+    BOOST_CHECK(CLatencyHistogram::BucketUpperBound(CLatencyHistogram::BucketIndex(1000)) <= 1250);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
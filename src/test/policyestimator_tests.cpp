@@ -5,6 +5,7 @@
 
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -178,6 +179,19 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     for (int i = 2; i < 9; i++) { // At 9, the original estimate was already at the bottom (b/c scale = 2)
         BOOST_CHECK(feeEst.estimateFee(i).GetFeePerK() < origFeeEst[i-1] - deltaFee);
     }
+
+    // A snapshot taken through memory reads back and reserializes identically
+    CDataStream ssEstimates(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEst.Write(ssEstimates));
+    CAutoFile fileEstimates(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!fileEstimates.IsNull());
+    fileEstimates.write(ssEstimates.data(), ssEstimates.size());
+    rewind(fileEstimates.Get());
+    CBlockPolicyEstimator feeEstRead;
+    BOOST_CHECK(feeEstRead.Read(fileEstimates));
+    CDataStream ssEstimatesRead(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEstRead.Write(ssEstimatesRead));
+    BOOST_CHECK(ssEstimates.str() == ssEstimatesRead.str());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
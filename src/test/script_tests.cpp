@@ -1469,4 +1469,147 @@ BOOST_AUTO_TEST_CASE(script_can_append_self)
     BOOST_CHECK(s == d);
 }
 
+/** Evaluate a pay-to-pubkeyhash spend the way VerifyScript would, using only EvalScript. */
+static bool ReferenceVerifyP2PKH(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness& witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    std::vector<std::vector<unsigned char> > stack;
+    if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
+        return false;
+    if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
+        return false;
+    // CHECKSIG leaves an empty vector for false, 1 for true
+    if (stack.empty() || stack.back().empty()) {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && stack.size() != 1) {
+        *serror = SCRIPT_ERR_CLEANSTACK;
+        return false;
+    }
+    if ((flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull()) {
+        *serror = SCRIPT_ERR_WITNESS_UNEXPECTED;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+/** Evaluate a pay-to-witness-pubkeyhash spend the way VerifyWitnessProgram would, using only EvalScript. */
+static bool ReferenceVerifyP2WPKH(const CScriptWitness& witness, const uint160& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    if (witness.stack.size() != 2) {
+        *serror = SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH;
+        return false;
+    }
+    for (const auto& elem : witness.stack) {
+        if (elem.size() > MAX_SCRIPT_ELEMENT_SIZE) {
+            *serror = SCRIPT_ERR_PUSH_SIZE;
+            return false;
+        }
+    }
+    std::vector<std::vector<unsigned char> > stack = witness.stack;
+    CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << ToByteVector(program) << OP_EQUALVERIFY << OP_CHECKSIG;
+    if (!EvalScript(stack, scriptCode, flags, checker, SIGVERSION_WITNESS_V0, serror))
+        return false;
+    if (stack.size() != 1 || stack.back().empty()) {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+/** Randomly damage a signature or public key in ways that exercise the encoding checks. */
+static std::vector<unsigned char> MutateScriptElement(std::vector<unsigned char> vch)
+{
+    switch (InsecureRandRange(8)) {
+    case 0: // flip a bit
+        if (!vch.empty())
+            vch[InsecureRandRange(vch.size())] ^= 1 << InsecureRandBits(3);
+        break;
+    case 1: // change the trailing hash type byte
+        if (!vch.empty())
+            vch.back() = InsecureRandBits(8);
+        break;
+    case 2: // truncate, possibly to the FindAndDelete-sensitive 20 bytes
+        vch.resize(InsecureRandBool() ? 20 : InsecureRandRange(vch.size() + 1));
+        break;
+    case 3: // extend
+        vch.resize(vch.size() + 1 + InsecureRandRange(600), InsecureRandBits(8));
+        break;
+    case 4:
+        vch.clear();
+        break;
+    default: // unchanged
+        break;
+    }
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(script_p2pkh_fast_path)
+{
+    // VerifyScript and VerifyWitnessProgram skip EvalScript for
+    // pay-to-pubkeyhash spends; they must agree with it on every outcome.
+    static const unsigned int vFlags[] = {SCRIPT_VERIFY_STRICTENC, SCRIPT_VERIFY_DERSIG, SCRIPT_VERIFY_LOW_S,
+        SCRIPT_VERIFY_NULLFAIL, SCRIPT_VERIFY_MINIMALDATA, SCRIPT_VERIFY_SIGPUSHONLY, SCRIPT_VERIFY_WITNESS_PUBKEYTYPE};
+
+    CKey key, otherKey;
+    key.MakeNewKey(InsecureRandBool());
+    otherKey.MakeNewKey(true);
+    const CAmount amount = 1000;
+
+    for (int i = 0; i < 2000; i++) {
+        const bool fWitness = i % 2;
+        unsigned int flags = SCRIPT_VERIFY_P2SH;
+        for (unsigned int flag : vFlags)
+            if (InsecureRandBool())
+                flags |= flag;
+        if (fWitness || InsecureRandBool()) {
+            flags |= SCRIPT_VERIFY_WITNESS;
+            if (InsecureRandBool())
+                flags |= SCRIPT_VERIFY_CLEANSTACK;
+        }
+
+        const CPubKey pubkey = key.GetPubKey();
+        const uint160 keyid = pubkey.GetID();
+        const CScript p2pkh = GetScriptForDestination(pubkey.GetID());
+        const CScript scriptPubKey = fWitness ? CScript() << OP_0 << ToByteVector(keyid) : p2pkh;
+        CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, amount);
+        CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), txCredit);
+
+        std::vector<unsigned char> vchSig;
+        const SigVersion sigversion = fWitness ? SIGVERSION_WITNESS_V0 : SIGVERSION_BASE;
+        uint256 hash = SignatureHash(p2pkh, txSpend, 0, SIGHASH_ALL, amount, sigversion);
+        BOOST_CHECK((InsecureRandRange(8) ? key : otherKey).Sign(hash, vchSig));
+        vchSig.push_back(SIGHASH_ALL);
+        std::vector<unsigned char> vchPubKey(pubkey.begin(), pubkey.end());
+        if (InsecureRandRange(4) == 0)
+            vchSig = MutateScriptElement(vchSig);
+        if (InsecureRandRange(4) == 0)
+            vchPubKey = MutateScriptElement(vchPubKey);
+
+        MutableTransactionSignatureChecker checker(&txSpend, 0, amount);
+        ScriptError err, errRef;
+        bool ret, retRef;
+        if (fWitness) {
+            CScriptWitness witness;
+            witness.stack.push_back(vchSig);
+            witness.stack.push_back(vchPubKey);
+            if (InsecureRandRange(8) == 0)
+                witness.stack.resize(InsecureRandRange(4));
+            ret = VerifyScript(CScript(), scriptPubKey, &witness, flags, checker, &err);
+            retRef = ReferenceVerifyP2WPKH(witness, keyid, flags, checker, &errRef);
+        } else {
+            CScript scriptSig = CScript() << vchSig << vchPubKey;
+            CScriptWitness witness;
+            if (InsecureRandRange(8) == 0)
+                witness.stack.push_back(vchSig);
+            ret = VerifyScript(scriptSig, scriptPubKey, &witness, flags, checker, &err);
+            retRef = ReferenceVerifyP2PKH(scriptSig, scriptPubKey, witness, flags, checker, &errRef);
+        }
+        BOOST_CHECK_EQUAL(ret, retRef);
+        BOOST_CHECK_MESSAGE(err == errRef, std::string(ScriptErrorString(err)) + " != " + ScriptErrorString(errRef));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
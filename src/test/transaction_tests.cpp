@@ -494,6 +494,48 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_repeated_key_transaction)
+{
+    // Two inputs spending outputs of the same address, so that both
+    // signature checks go through the key parsed in PrecomputedTransactionData
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000100"), 0);
+    mtx.vin[1].prevout = COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000100"), 1);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1000;
+    mtx.vout[0].scriptPubKey = CScript() << OP_1;
+    for (unsigned int i = 0; i < mtx.vin.size(); i++)
+        BOOST_CHECK(SignSignature(keystore, scriptPubKey, mtx, i, 1000, SIGHASH_ALL));
+
+    const CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        ScriptError err;
+        BOOST_CHECK_MESSAGE(VerifyScript(tx.vin[i].scriptSig, scriptPubKey, nullptr, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i, 1000, txdata), &err), ScriptErrorString(err));
+    }
+    BOOST_CHECK(txdata.FindParsedKey(tx, key.GetPubKey()) != nullptr);
+    BOOST_CHECK(txdata.FindParsedKey(tx, keyOther.GetPubKey()) == nullptr);
+
+    // Swapped signatures are checked against the parsed key too, and fail
+    std::swap(mtx.vin[0].scriptSig, mtx.vin[1].scriptSig);
+    const CTransaction txSwapped(mtx);
+    PrecomputedTransactionData txdataSwapped(txSwapped);
+    for (unsigned int i = 0; i < txSwapped.vin.size(); i++) {
+        ScriptError err;
+        BOOST_CHECK(!VerifyScript(txSwapped.vin[i].scriptSig, scriptPubKey, nullptr, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txSwapped, i, 1000, txdataSwapped), &err));
+    }
+    BOOST_CHECK(txdataSwapped.FindParsedKey(txSwapped, key.GetPubKey()) != nullptr);
+}
+
 BOOST_AUTO_TEST_CASE(test_witness)
 {
     CBasicKeyStore keystore, keystore2;
@@ -19,6 +19,9 @@
 #include "keystore.h"
 #include "policy/policy.h"
 
+#include <atomic>
+#include <thread>
+
 #include <boost/test/unit_test.hpp>
 
 #include "util.h"
@@ -383,4 +386,95 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    auto sign = [&](CMutableTransaction& tx) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+    };
+
+    // A parent spending the mature coinbase and a child spending the parent
+    CMutableTransaction parent;
+    parent.nVersion = 1;
+    parent.vin.resize(1);
+    parent.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    parent.vin[0].prevout.n = 0;
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 11*CENT;
+    parent.vout[0].scriptPubKey = scriptPubKey;
+    sign(parent);
+
+    CMutableTransaction child;
+    child.nVersion = 1;
+    child.vin.resize(1);
+    child.vin[0].prevout.hash = parent.GetHash();
+    child.vin[0].prevout.n = 0;
+    child.vout.resize(1);
+    child.vout[0].nValue = 10*CENT;
+    child.vout[0].scriptPubKey = scriptPubKey;
+    sign(child);
+
+    // The child comes first but is accepted in the same pass as its parent
+    std::vector<CTransactionRef> vtx = {MakeTransactionRef(child), MakeTransactionRef(parent)};
+    std::vector<CValidationState> vState;
+    std::vector<bool> vfMissingInputs;
+    std::vector<bool> vfAccepted = AcceptToMemoryPoolBatch(mempool, vtx, vState, vfMissingInputs, 0);
+    BOOST_CHECK(vfAccepted[0] && vfAccepted[1]);
+    BOOST_CHECK(mempool.exists(child.GetHash()));
+    BOOST_CHECK(mempool.exists(parent.GetHash()));
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    // With no room in the mempool the parent is trimmed as soon as it is
+    // accepted, and the child then misses its input
+    mempool.clear();
+    gArgs.ForceSetArg("-maxmempool", "0");
+    vfAccepted = AcceptToMemoryPoolBatch(mempool, vtx, vState, vfMissingInputs, 0);
+    BOOST_CHECK(!vfAccepted[0] && !vfAccepted[1]);
+    BOOST_CHECK_EQUAL(vState[1].GetRejectReason(), "mempool full");
+    BOOST_CHECK(vfMissingInputs[0]);
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+    gArgs.ForceSetArg("-maxmempool", std::to_string(DEFAULT_MAX_MEMPOOL_SIZE));
+    mempool.clear();
+
+    // Batches above the maximum are rejected as a whole
+    std::vector<CTransactionRef> vtxLarge(MAX_MEMPOOL_BATCH_SIZE + 1, MakeTransactionRef(parent));
+    vfAccepted = AcceptToMemoryPoolBatch(mempool, vtxLarge, vState, vfMissingInputs, 0);
+    BOOST_CHECK(std::find(vfAccepted.begin(), vfAccepted.end(), true) == vfAccepted.end());
+    BOOST_CHECK_EQUAL(vState[0].GetRejectReason(), "batch-too-large");
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // Batches submitted while blocks are being connected share the script
+    // check threads with ConnectBlock, which must not deadlock
+    std::atomic<bool> fStop(false);
+    std::atomic<int> nSubmitted(0);
+    std::atomic<int> nRejected(0);
+    std::thread submitter([&]() {
+        while (!fStop) {
+            std::vector<CValidationState> vStateBatch;
+            std::vector<bool> vfMissingInputsBatch;
+            std::vector<bool> vfAcceptedBatch = AcceptToMemoryPoolBatch(mempool, vtx, vStateBatch, vfMissingInputsBatch, 0);
+            if (!vfAcceptedBatch[0] || !vfAcceptedBatch[1])
+                nRejected++;
+            LOCK(cs_main);
+            mempool.clear();
+            nSubmitted++;
+        }
+    });
+    while (nSubmitted == 0)
+        std::this_thread::yield();
+    const int nHeight = chainActive.Height();
+    std::vector<CMutableTransaction> noTxns;
+    for (int i = 0; i < 10; i++)
+        CreateAndProcessBlock(noTxns, scriptPubKey);
+    fStop = true;
+    submitter.join();
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight + 10);
+    BOOST_CHECK_EQUAL(nRejected.load(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -38,6 +38,8 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+
+    nEpoch = 0;
 }
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
@@ -62,41 +64,48 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+    const EpochGuard guard(*this);
+    std::vector<txiter> vStage, vAllDescendants;
+    for (const txiter childEntry : GetMemPoolChildren(updateIt)) {
+        if (!Visited(childEntry))
+            vStage.push_back(childEntry);
+    }
+
+    while (!vStage.empty()) {
+        const txiter cit = vStage.back();
+        vStage.pop_back();
+        vAllDescendants.push_back(cit);
+        const LinkEntries &setChildren = GetMemPoolChildren(cit);
         for (const txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (const txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!Visited(cacheEntry))
+                        vAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!Visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                vStage.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    for (txiter cit : vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            cachedDescendants[updateIt].push_back(cit);
             // Update ancestor state for each descendant
+            UpdateFeeBucket(*cit, false);
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            UpdateFeeBucket(*cit, true);
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -125,25 +134,27 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // setMemPoolChildren will be updated, an assumption made in
     // UpdateForDescendants.
     for (const uint256 &hash : reverse_iterate(vHashesToUpdate)) {
-        // we cache the in-mempool children to avoid duplicate updates
-        setEntries setChildren;
         // calculate children from mapNextTx
         txiter it = mapTx.find(hash);
         if (it == mapTx.end()) {
             continue;
         }
-        auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
-        // First calculate the children, and update setMemPoolChildren to
-        // include them, and update their setMemPoolParents to include this tx.
-        for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
-            const uint256 &childHash = iter->second->GetHash();
-            txiter childIter = mapTx.find(childHash);
-            assert(childIter != mapTx.end());
-            // We can skip updating entries we've encountered before or that
-            // are in the block (which are already accounted for).
-            if (setChildren.insert(childIter).second && !setAlreadyIncluded.count(childHash)) {
-                UpdateChild(it, childIter, true);
-                UpdateParent(childIter, it, true);
+        {
+            // The epoch marks children already seen, to avoid duplicate updates
+            const EpochGuard guard(*this);
+            auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
+            // First calculate the children, and update setMemPoolChildren to
+            // include them, and update their setMemPoolParents to include this tx.
+            for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
+                const uint256 &childHash = iter->second->GetHash();
+                txiter childIter = mapTx.find(childHash);
+                assert(childIter != mapTx.end());
+                // We can skip updating entries we've encountered before or that
+                // are in the block (which are already accounted for).
+                if (!Visited(childIter) && !setAlreadyIncluded.count(childHash)) {
+                    UpdateChild(it, childIter, true);
+                    UpdateParent(childIter, it, true);
+                }
             }
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
@@ -154,7 +165,12 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 {
     LOCK(cs);
 
-    setEntries parentHashes;
+    const EpochGuard guard(*this);
+    // Entries in the stage are visited but not yet in setAncestors
+    std::vector<txiter> vStage;
+    for (const txiter ancestorIt : setAncestors) {
+        Visited(ancestorIt);
+    }
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -163,9 +179,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
-                if (parentHashes.size() + 1 > limitAncestorCount) {
+            if (piter != mapTx.end() && !Visited(piter)) {
+                vStage.push_back(piter);
+                if (vStage.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
@@ -175,16 +191,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const txiter piter : GetMemPoolParents(it)) {
+            if (!Visited(piter))
+                vStage.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+    while (!vStage.empty()) {
+        txiter stageit = vStage.back();
+        vStage.pop_back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -198,13 +217,13 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
+        const LinkEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!Visited(phash)) {
+                vStage.push_back(phash);
             }
-            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (vStage.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
@@ -216,7 +235,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const LinkEntries &parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters) {
         UpdateChild(piter, it, add);
@@ -245,7 +264,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const LinkEntries &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -263,15 +282,26 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // Here we only update statistics and not data in mapLinks (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
+        std::vector<txiter> vStage;
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            const EpochGuard guard(*this);
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+            // Walk all descendants, not updating state for self
+            Visited(removeIt);
+            vStage.push_back(removeIt);
+            while (!vStage.empty()) {
+                txiter it = vStage.back();
+                vStage.pop_back();
+                for (const txiter childIt : GetMemPoolChildren(it)) {
+                    if (!Visited(childIt)) {
+                        UpdateFeeBucket(*childIt, false);
+                        mapTx.modify(childIt, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                        UpdateFeeBucket(*childIt, true);
+                        vStage.push_back(childIt);
+                    }
+                }
             }
         }
     }
@@ -330,8 +360,12 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator), nEpoch(0), fEpochGuarded(false)
 {
+    vFeeBuckets.push_back(MempoolFeeCheckpoint{CFeeRate(0), 0, 0});
+    for (double bound = MEMPOOL_FEE_BUCKET_MIN; bound <= MEMPOOL_FEE_BUCKET_MAX; bound *= MEMPOOL_FEE_BUCKET_SPACING)
+        vFeeBuckets.push_back(MempoolFeeCheckpoint{CFeeRate((CAmount)bound), 0, 0});
+
     _clear(); //lock free clear
 
     // Sanity checks off by default for performance, because otherwise
@@ -360,7 +394,6 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
-    NotifyEntryAdded(entry.GetSharedTx());
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
@@ -406,6 +439,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
+    UpdateFeeBucket(*newit, true);
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
@@ -414,6 +448,9 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
+    // Notify once the entry is fully linked, so listeners can look it up
+    NotifyEntryAdded(entry.GetSharedTx());
+
     return true;
 }
 
@@ -435,8 +472,9 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    cachedInnerUsage -= mapLinks[it].parents.DynamicMemoryUsage() + mapLinks[it].children.DynamicMemoryUsage();
     mapLinks.erase(it);
+    UpdateFeeBucket(*it, false);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -450,22 +488,21 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+    std::vector<txiter> vStage;
+    if (setDescendants.insert(entryit).second) {
+        vStage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
-    while (!stage.empty()) {
-        txiter it = *stage.begin();
-        setDescendants.insert(it);
-        stage.erase(it);
+    while (!vStage.empty()) {
+        txiter it = vStage.back();
+        vStage.pop_back();
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const LinkEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (setDescendants.insert(childiter).second) {
+                vStage.push_back(childiter);
             }
         }
     }
@@ -596,6 +633,10 @@ void CTxMemPool::_clear()
     mapNextTx.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    for (MempoolFeeCheckpoint& bucket : vFeeBuckets) {
+        bucket.nSize = 0;
+        bucket.nCount = 0;
+    }
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -629,6 +670,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    std::vector<uint64_t> vBucketSize(vFeeBuckets.size()), vBucketCount(vFeeBuckets.size());
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -639,11 +681,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
+        vBucketSize[FeeBucketIndex(*it)] += it->GetTxSize();
+        vBucketCount[FeeBucketIndex(*it)]++;
         const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += links.parents.DynamicMemoryUsage() + links.children.DynamicMemoryUsage();
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -669,7 +713,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(GetMemPoolParents(it) == setParentCheck);
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -702,7 +746,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(GetMemPoolChildren(it) == setChildrenCheck);
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -737,6 +781,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    for (size_t i = 0; i < vFeeBuckets.size(); i++) {
+        assert(vFeeBuckets[i].nSize == vBucketSize[i]);
+        assert(vFeeBuckets[i].nCount == vBucketCount[i]);
+    }
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -815,6 +863,27 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoForRelay(const std::vector<uint256>& vtxid) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(vtxid.size());
+    for (const uint256& hash : vtxid) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end())
+            iters.push_back(i);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -841,7 +910,9 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         delta += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            UpdateFeeBucket(*it, false);
             mapTx.modify(it, update_fee_delta(delta));
+            UpdateFeeBucket(*it, true);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -855,9 +926,12 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             CalculateDescendants(it, setDescendants);
             setDescendants.erase(it);
             for (txiter descendantIt : setDescendants) {
+                UpdateFeeBucket(*descendantIt, false);
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
+                UpdateFeeBucket(*descendantIt, true);
             }
             ++nTransactionsUpdated;
+            NotifyEntryPrioritised(it->GetSharedTx());
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -947,25 +1021,25 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    LinkEntries& children = mapLinks[entry].children;
+    const size_t nUsageBefore = children.DynamicMemoryUsage();
+    if (add ? children.insert(child) : children.erase(child)) {
+        cachedInnerUsage -= nUsageBefore;
+        cachedInnerUsage += children.DynamicMemoryUsage();
     }
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    LinkEntries& parents = mapLinks[entry].parents;
+    const size_t nUsageBefore = parents.DynamicMemoryUsage();
+    if (add ? parents.insert(parent) : parents.erase(parent)) {
+        cachedInnerUsage -= nUsageBefore;
+        cachedInnerUsage += parents.DynamicMemoryUsage();
     }
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::LinkEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -973,7 +1047,7 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
     return it->second.parents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::LinkEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -981,6 +1055,29 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) cons
     return it->second.children;
 }
 
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& poolIn) : pool(poolIn)
+{
+    AssertLockHeld(pool.cs);
+    assert(!pool.fEpochGuarded);
+    ++pool.nEpoch;
+    pool.fEpochGuarded = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    // Bump again, so entries visited during this epoch read as unvisited in the next
+    ++pool.nEpoch;
+    pool.fEpochGuarded = false;
+}
+
+bool CTxMemPool::Visited(txiter it) const
+{
+    assert(fEpochGuarded);
+    bool fVisited = it->nEpoch >= nEpoch;
+    it->nEpoch = nEpoch;
+    return fVisited;
+}
+
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     LOCK(cs);
     if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
@@ -1005,6 +1102,64 @@ CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     return std::max(CFeeRate(llround(rollingMinimumFeeRate)), incrementalRelayFee);
 }
 
+size_t CTxMemPool::FeeBucketIndex(const CTxMemPoolEntry& entry) const
+{
+    CFeeRate rate(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors());
+    auto it = std::upper_bound(vFeeBuckets.begin(), vFeeBuckets.end(), rate,
+        [](const CFeeRate& rateIn, const MempoolFeeCheckpoint& bucket) { return rateIn < bucket.feeRate; });
+    // Negative feerates from prioritisation go in the first bucket
+    return it == vFeeBuckets.begin() ? 0 : (it - vFeeBuckets.begin()) - 1;
+}
+
+void CTxMemPool::UpdateFeeBucket(const CTxMemPoolEntry& entry, bool add)
+{
+    MempoolFeeCheckpoint& bucket = vFeeBuckets[FeeBucketIndex(entry)];
+    if (add) {
+        bucket.nSize += entry.GetTxSize();
+        bucket.nCount++;
+    } else {
+        bucket.nSize -= entry.GetTxSize();
+        bucket.nCount--;
+    }
+}
+
+CFeeRate CTxMemPool::GetFeeRateAtDepth(uint64_t nDepth) const
+{
+    LOCK(cs);
+    uint64_t nSize = 0;
+    for (auto it = vFeeBuckets.rbegin(); it != vFeeBuckets.rend(); ++it) {
+        nSize += it->nSize;
+        if (it->nCount && nSize >= nDepth)
+            return it->feeRate;
+    }
+    return CFeeRate(0);
+}
+
+std::vector<MempoolFeeCheckpoint> CTxMemPool::GetFeeCheckpoints() const
+{
+    std::vector<MempoolFeeCheckpoint> vCheckpoints;
+    uint64_t nSize = 0;
+    uint64_t nCount = 0;
+    LOCK(cs);
+    for (auto it = vFeeBuckets.rbegin(); it != vFeeBuckets.rend(); ++it) {
+        if (!it->nCount)
+            continue;
+        nSize += it->nSize;
+        nCount += it->nCount;
+        vCheckpoints.push_back(MempoolFeeCheckpoint{it->feeRate, nSize, nCount});
+    }
+    return vCheckpoints;
+}
+
+CFeeRate CTxMemPool::FeeRateAtDepth(const std::vector<MempoolFeeCheckpoint>& vCheckpoints, uint64_t nDepth)
+{
+    auto it = std::lower_bound(vCheckpoints.begin(), vCheckpoints.end(), nDepth,
+        [](const MempoolFeeCheckpoint& checkpoint, uint64_t nDepthIn) { return checkpoint.nSize < nDepthIn; });
+    if (it == vCheckpoints.end())
+        return CFeeRate(0);
+    return it->feeRate;
+}
+
 void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     AssertLockHeld(cs);
     if (rate.GetFeePerK() > rollingMinimumFeeRate) {
@@ -7,6 +7,7 @@
 #ifndef SUCRECOIN_TXMEMPOOL_H
 #define SUCRECOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <map>
@@ -67,8 +68,8 @@ class CTxMemPoolEntry
 private:
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
-    size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    size_t nUsageSize;         //!< ... and total memory usage
+    uint32_t nTxWeight;        //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    uint32_t nUsageSize;       //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
     unsigned int entryHeight;  //!< Chain height when entering the mempool
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
@@ -129,6 +130,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpoch; //!< Last traversal epoch this entry was visited in, see CTxMemPool::EpochGuard
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -293,6 +295,25 @@ struct ancestor_score {};
 
 class CBlockPolicyEstimator;
 
+/** Lower bound of the second ancestor feerate bucket, in satoshis per kB; the first holds everything cheaper */
+static const CAmount MEMPOOL_FEE_BUCKET_MIN = 1000;
+/** Lower bound of the last ancestor feerate bucket, in satoshis per kB */
+static const CAmount MEMPOOL_FEE_BUCKET_MAX = 10000000;
+/** Ratio between the lower bounds of neighbouring ancestor feerate buckets */
+static const double MEMPOOL_FEE_BUCKET_SPACING = 1.1;
+
+/**
+ * A point along the ancestor-score order of the mempool: the transactions
+ * with an ancestor feerate of at least feeRate add up to nSize virtual bytes
+ * and nCount transactions.
+ */
+struct MempoolFeeCheckpoint
+{
+    CFeeRate feeRate;
+    uint64_t nSize;
+    uint64_t nCount;
+};
+
 /**
  * Information about a mempool transaction.
  */
@@ -424,8 +445,22 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable uint64_t nEpoch;    //!< Current traversal epoch, see EpochGuard
+    mutable bool fEpochGuarded; //!< Whether an EpochGuard is alive
+
+    /** Size and count of the entries in each ancestor feerate bucket, by
+     *  ascending lower bound. Kept up to date on every change to an entry's
+     *  ancestor state, see UpdateFeeBucket. */
+    std::vector<MempoolFeeCheckpoint> vFeeBuckets;
+
     void trackPackageRemoved(const CFeeRate& rate);
 
+    /** Index into vFeeBuckets for the current ancestor feerate of entry */
+    size_t FeeBucketIndex(const CTxMemPoolEntry& entry) const;
+    /** Add entry to, or remove it from, the bucket for its ancestor feerate.
+     *  Must bracket every change to the entry's ancestor fees or size. */
+    void UpdateFeeBucket(const CTxMemPoolEntry& entry, bool add);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -475,14 +510,72 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    /**
+     * Hash-sorted vector of entries, used for the parent and child links.
+     * Most transactions have few in-mempool parents and children, and a
+     * std::set node per link costs several times the size of the iterator.
+     * Iterates in the same order a setEntries would.
+     */
+    class LinkEntries
+    {
+    private:
+        std::vector<txiter> vEntries;
+
+    public:
+        typedef std::vector<txiter>::const_iterator const_iterator;
+
+        const_iterator begin() const { return vEntries.begin(); }
+        const_iterator end() const { return vEntries.end(); }
+        size_t size() const { return vEntries.size(); }
+        bool empty() const { return vEntries.empty(); }
+
+        bool insert(txiter it) {
+            std::vector<txiter>::iterator pos = std::lower_bound(vEntries.begin(), vEntries.end(), it, CompareIteratorByHash());
+            if (pos != vEntries.end() && *pos == it)
+                return false;
+            vEntries.insert(pos, it);
+            return true;
+        }
+        size_t erase(txiter it) {
+            std::vector<txiter>::iterator pos = std::lower_bound(vEntries.begin(), vEntries.end(), it, CompareIteratorByHash());
+            if (pos == vEntries.end() || *pos != it)
+                return 0;
+            vEntries.erase(pos);
+            if (vEntries.size() * 2 < vEntries.capacity())
+                vEntries.shrink_to_fit();
+            return 1;
+        }
+        bool operator==(const setEntries& other) const {
+            return vEntries.size() == other.size() && std::equal(vEntries.begin(), vEntries.end(), other.begin());
+        }
+        size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vEntries); }
+    };
+
+    const LinkEntries & GetMemPoolParents(txiter entry) const;
+    const LinkEntries & GetMemPoolChildren(txiter entry) const;
+
+    /**
+     * Graph walks mark the entries they reach with the current epoch instead
+     * of collecting them in a std::set, so a walk costs O(entries reached)
+     * and allocates nothing beyond its work list. An EpochGuard starts a new
+     * epoch for the duration of one walk; walks cannot be nested. cs must be
+     * held.
+     */
+    class EpochGuard {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& poolIn);
+        ~EpochGuard();
+    };
+    /** Mark an entry visited in the current epoch; returns whether it already was */
+    bool Visited(txiter it) const;
+
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        LinkEntries parents;
+        LinkEntries children;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -586,6 +679,20 @@ public:
       */
     CFeeRate GetMinFee(size_t sizelimit) const;
 
+    /** The ancestor feerate at which the ancestor-score order reaches nDepth
+     *  virtual bytes, to within MEMPOOL_FEE_BUCKET_SPACING, i.e. roughly what
+     *  a transaction needs to pay to be mined within that many bytes. Zero if
+     *  the whole mempool fits. */
+    CFeeRate GetFeeRateAtDepth(uint64_t nDepth) const;
+
+    /** Cumulative size checkpoints along the ancestor-score order, one per
+     *  non-empty ancestor feerate bucket, best feerate first. Depths can be
+     *  looked up in them with FeeRateAtDepth. */
+    std::vector<MempoolFeeCheckpoint> GetFeeCheckpoints() const;
+
+    /** The feerate at depth nDepth according to checkpoints from GetFeeCheckpoints */
+    static CFeeRate FeeRateAtDepth(const std::vector<MempoolFeeCheckpoint>& vCheckpoints, uint64_t nDepth);
+
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
@@ -619,11 +726,16 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Info for those of the given transactions that are still in the mempool,
+     *  in the order used for relay (see DepthAndScoreComparator). Unlike
+     *  repeated CompareDepthAndScore calls this takes cs once. */
+    std::vector<TxMempoolInfo> infoForRelay(const std::vector<uint256>& vtxid) const;
 
     size_t DynamicMemoryUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    boost::signals2::signal<void (CTransactionRef)> NotifyEntryPrioritised;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
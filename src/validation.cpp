@@ -70,6 +70,100 @@ CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+/**
+ * Shared by block validation and the mempool. Every user holds cs_main while
+ * it controls the queue, so the users run one at a time and never take
+ * cs_main and the queue's control mutex in different orders.
+ */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+/** A database read of one coin, run on the block preparation threads by PrefetchBlockCoins */
+class CCoinsPrefetch
+{
+private:
+    const COutPoint* pOutpoint;
+    Coin* pCoin;
+
+public:
+    CCoinsPrefetch(): pOutpoint(nullptr), pCoin(nullptr) {}
+    CCoinsPrefetch(const COutPoint& outpointIn, Coin& coinIn): pOutpoint(&outpointIn), pCoin(&coinIn) {}
+
+    bool operator()() {
+        try {
+            pcoinsdbview->GetCoin(*pOutpoint, *pCoin);
+        } catch (const std::exception&) {
+            // Leave it to the regular lookup, which reports database errors
+            pCoin->Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& other) {
+        std::swap(pOutpoint, other.pOutpoint);
+        std::swap(pCoin, other.pCoin);
+    }
+};
+
+/**
+ * Closure representing the per-transaction work of ConnectBlock that does
+ * not depend on the UTXO set: the signature hash precomputation and the
+ * legacy sigop count.
+ */
+class CTxPrecompute
+{
+private:
+    const CTransaction* ptx;
+    PrecomputedTransactionData* ptxdata;
+    int64_t* pnLegacySigOpsCost;
+
+public:
+    CTxPrecompute(): ptx(nullptr), ptxdata(nullptr), pnLegacySigOpsCost(nullptr) {}
+    CTxPrecompute(const CTransaction& txIn, PrecomputedTransactionData& txdataIn, int64_t& nLegacySigOpsCostIn) :
+        ptx(&txIn), ptxdata(&txdataIn), pnLegacySigOpsCost(&nLegacySigOpsCostIn) {}
+
+    bool operator()() {
+        ptxdata->Init(*ptx);
+        *pnLegacySigOpsCost = GetLegacySigOpCount(*ptx) * WITNESS_SCALE_FACTOR;
+        return true;
+    }
+
+    void swap(CTxPrecompute& other) {
+        std::swap(ptx, other.ptx);
+        std::swap(ptxdata, other.ptxdata);
+        std::swap(pnLegacySigOpsCost, other.pnLegacySigOpsCost);
+    }
+};
+
+/**
+ * A unit of work for the block preparation threads: either a CCoinsPrefetch
+ * or a CTxPrecompute. Both run ahead of ConnectBlock's script checks with
+ * cs_main held, never at the same time, so they share one pool of threads.
+ */
+class CBlockPrepareJob
+{
+private:
+    CCoinsPrefetch prefetch;
+    CTxPrecompute precompute;
+    bool fPrefetch;
+
+public:
+    CBlockPrepareJob(): fPrefetch(false) {}
+    explicit CBlockPrepareJob(const CCoinsPrefetch& prefetchIn): prefetch(prefetchIn), fPrefetch(true) {}
+    explicit CBlockPrepareJob(const CTxPrecompute& precomputeIn): precompute(precomputeIn), fPrefetch(false) {}
+
+    bool operator()() {
+        return fPrefetch ? prefetch() : precompute();
+    }
+
+    void swap(CBlockPrepareJob& other) {
+        prefetch.swap(other.prefetch);
+        precompute.swap(other.precompute);
+        std::swap(fPrefetch, other.fPrefetch);
+    }
+};
+
+// Coin reads are I/O bound, so workers take few at a time
+static CCheckQueue<CBlockPrepareJob> blockpreparequeue(16);
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
@@ -326,6 +420,8 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
 // Returns the script flags which should be checked for a given block
 static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
 
+static void PrecheckMempoolScripts(const std::vector<CTransactionRef>& vtx, std::vector<std::vector<COutPoint>>* pvCoinsToUncache);
+
 static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     int expired = pool.Expire(GetTime() - age);
     if (expired != 0) {
@@ -447,9 +543,37 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/**
+ * CheckInputs for mempool acceptance. The script checks of a transaction with
+ * several inputs are spread over the script check threads, which are idle
+ * here since all of their users hold cs_main. If any check fails they are
+ * repeated serially, so state gets the same reject reason as without threads.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view,
+                 unsigned int flags, PrecomputedTransactionData& txdata) {
+    AssertLockHeld(cs_main);
+
+    if (!nScriptCheckThreads || tx.vin.size() < 2)
+        return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks))
+        return false;
+    if (vChecks.empty())
+        return true;
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait())
+        return true;
+
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache,
+                              bool fDeferLimitAndNotify = false)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -800,7 +924,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsParallel(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -870,6 +994,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
+        // The batch caller trims and notifies once for all its transactions
+        if (fDeferLimitAndNotify)
+            return true;
+
         // trim mempool and check if tx was trimmed
         if (!bypass_limits) {
             LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
@@ -908,6 +1036,117 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+/** Order a batch so that every transaction comes after the transactions of the batch it spends. */
+static std::vector<size_t> SortBatchByDependencies(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.emplace(vtx[i]->GetHash(), i);
+
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    std::vector<bool> vVisited(vtx.size(), false);
+    // Depth-first walk of the in-batch parents, as (index, next input) pairs
+    std::vector<std::pair<size_t, size_t>> vStack;
+    for (size_t nRoot = 0; nRoot < vtx.size(); nRoot++) {
+        if (vVisited[nRoot])
+            continue;
+        vVisited[nRoot] = true;
+        vStack.emplace_back(nRoot, 0);
+        while (!vStack.empty()) {
+            const size_t i = vStack.back().first;
+            const size_t nIn = vStack.back().second++;
+            if (nIn < vtx[i]->vin.size()) {
+                auto it = mapIndex.find(vtx[i]->vin[nIn].prevout.hash);
+                if (it != mapIndex.end() && !vVisited[it->second]) {
+                    vVisited[it->second] = true;
+                    vStack.emplace_back(it->second, 0);
+                }
+                continue;
+            }
+            vOrder.push_back(i);
+            vStack.pop_back();
+        }
+    }
+    return vOrder;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx,
+                        std::vector<CValidationState>& vState, std::vector<bool>& vfMissingInputs,
+                        const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<bool> vfAccepted(vtx.size(), false);
+    vState.assign(vtx.size(), CValidationState());
+    vfMissingInputs.assign(vtx.size(), false);
+
+    if (vtx.size() > MAX_MEMPOOL_BATCH_SIZE) {
+        for (CValidationState& state : vState)
+            state.DoS(0, false, REJECT_INVALID, "batch-too-large");
+        return vfAccepted;
+    }
+
+    // Parents first, so that a single pass accepts every chain in the batch
+    const std::vector<size_t> vOrder = SortBatchByDependencies(vtx);
+
+    LOCK(cs_main);
+
+    // Check the scripts of the whole batch on the script check threads;
+    // the checks below then hit the script cache. vCoinsToUncache is
+    // indexed like vOrder.
+    std::vector<std::vector<COutPoint>> vCoinsToUncache;
+    if (nScriptCheckThreads) {
+        std::vector<CTransactionRef> vtxSorted;
+        vtxSorted.reserve(vtx.size());
+        for (const size_t i : vOrder)
+            vtxSorted.push_back(vtx[i]);
+        PrecheckMempoolScripts(vtxSorted, &vCoinsToUncache);
+    }
+
+    const int64_t nAcceptTime = GetTime();
+    const size_t nMaxMempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    const unsigned long nMempoolExpiry = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+
+    for (const size_t i : vOrder) {
+        bool fMissingInputs = false;
+        std::vector<COutPoint> coins_to_uncache;
+        if (AcceptToMemoryPoolWorker(chainparams, pool, vState[i], vtx[i], &fMissingInputs, nAcceptTime, nullptr, false, nAbsurdFee, coins_to_uncache, true)) {
+            vfAccepted[i] = true;
+            // Trim as soon as the pool outgrows its limit rather than
+            // letting a large batch overshoot it until the end.
+            if (pool.DynamicMemoryUsage() > nMaxMempool)
+                LimitMempoolSize(pool, nMaxMempool, nMempoolExpiry);
+            continue;
+        }
+        for (const COutPoint& hashTx : coins_to_uncache)
+            pcoinsTip->Uncache(hashTx);
+        vfMissingInputs[i] = fMissingInputs;
+    }
+
+    LimitMempoolSize(pool, nMaxMempool, nMempoolExpiry);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!vfAccepted[i])
+            continue;
+        if (!pool.exists(vtx[i]->GetHash())) {
+            vfAccepted[i] = false;
+            vState[i].DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+            continue;
+        }
+        GetMainSignals().TransactionAddedToMempool(vtx[i]);
+    }
+    for (size_t j = 0; j < vCoinsToUncache.size(); j++) {
+        if (vfAccepted[vOrder[j]])
+            continue;
+        for (const COutPoint& outpoint : vCoinsToUncache[j])
+            pcoinsTip->Uncache(outpoint);
+    }
+
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return vfAccepted;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1239,7 +1478,12 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
-    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
+    if (!VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error)) {
+        if (!pfFailed)
+            return false;
+        pfFailed->store(true, std::memory_order_relaxed);
+    }
+    return true;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1262,6 +1506,17 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/** Key under which a successful script execution of tx with flags is cached */
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1298,11 +1553,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // correct (ie that the transaction hash which is in tx's prevouts
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
-            uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            const uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1564,13 +1815,86 @@ void static FlushBlockFile(bool fFinalize = false)
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("sucrecoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void ThreadBlockPrepare() {
+    RenameThread("sucrecoin-blkprep");
+    blockpreparequeue.Thread();
+}
+
+/**
+ * Run the UTXO-independent per-transaction work of ConnectBlock on the
+ * block preparation threads, so that the connect loop only does the
+ * bookkeeping that needs the coins view. vTxData and vLegacySigOpsCost must
+ * have one element per transaction.
+ */
+static void PrecomputeBlockTransactions(const CBlock& block, std::vector<PrecomputedTransactionData>& vTxData, std::vector<int64_t>& vLegacySigOpsCost)
+{
+    assert(vTxData.size() == block.vtx.size() && vLegacySigOpsCost.size() == block.vtx.size());
+    std::vector<CBlockPrepareJob> vWork;
+    vWork.reserve(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        vWork.emplace_back(CTxPrecompute(*block.vtx[i], vTxData[i], vLegacySigOpsCost[i]));
+
+    if (!nScriptCheckThreads || vWork.size() < 2) {
+        for (CBlockPrepareJob& work : vWork)
+            work();
+        return;
+    }
+    CCheckQueueControl<CBlockPrepareJob> control(&blockpreparequeue);
+    control.Add(vWork);
+    control.Wait();
+}
+
+/**
+ * Load the coins a block spends into pcoinsTip before ConnectBlock needs
+ * them. Those neither cached nor created within the block are read from the
+ * database in parallel on the block preparation threads, instead of one synchronous
+ * read at a time in ConnectBlock's input loop.
+ */
+static void PrefetchBlockCoins(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads || !pcoinsdbview)
+        return;
+
+    std::set<uint256> setBlockTxids;
+    for (const auto& tx : block.vtx)
+        setBlockTxids.insert(tx->GetHash());
+
+    std::vector<COutPoint> vOutpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!setBlockTxids.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                vOutpoints.push_back(txin.prevout);
+        }
+    }
+    if (vOutpoints.size() < 2)
+        return;
+
+    std::vector<Coin> vCoins(vOutpoints.size());
+    std::vector<CBlockPrepareJob> vReads;
+    vReads.reserve(vOutpoints.size());
+    for (size_t i = 0; i < vOutpoints.size(); i++)
+        vReads.emplace_back(CCoinsPrefetch(vOutpoints[i], vCoins[i]));
+
+    {
+        CCheckQueueControl<CBlockPrepareJob> control(&blockpreparequeue);
+        control.Add(vReads);
+        control.Wait();
+    }
+
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        if (!vCoins[i].IsSpent())
+            pcoinsTip->PrefetchCoin(vOutpoints[i], std::move(vCoins[i]));
+    }
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1782,8 +2106,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
-    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    // Sized up front so that pointers to individual PrecomputedTransactionData don't get invalidated
+    std::vector<PrecomputedTransactionData> txdata(block.vtx.size());
+    std::vector<int64_t> vLegacySigOpsCost(block.vtx.size());
+    PrecomputeBlockTransactions(block, txdata, vLegacySigOpsCost);
+    // CheckInputs cannot cache the results of checks it hands to the check
+    // queue; collect their cache entries and store them once the queue
+    // succeeded, so that validating the next block template does not verify
+    // the same scripts again.
+    std::vector<uint256> vScriptCacheEntries;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1816,16 +2147,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             }
         }
 
-        // GetTransactionSigOpCost counts 3 types of sigops:
-        // * legacy (always)
+        // The sigop cost counts 3 types of sigops:
+        // * legacy (always, precomputed above)
         // * p2sh (when P2SH enabled in flags and excludes coinbase)
         // * witness (when witness enabled in flags and excludes coinbase)
-        nSigOpsCost += GetTransactionSigOpCost(tx, view, flags);
+        nSigOpsCost += vLegacySigOpsCost[i] + GetTransactionInputSigOpCost(tx, view, flags);
         if (nSigOpsCost > MAX_BLOCK_SIGOPS_COST)
             return state.DoS(100, error("ConnectBlock(): too many sigops"),
                              REJECT_INVALID, "bad-blk-sigops");
 
-        txdata.emplace_back(tx);
         if (!tx.IsCoinBase())
         {
             std::vector<CScriptCheck> vChecks;
@@ -1833,6 +2163,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
+            if (fCacheResults && !vChecks.empty())
+                vScriptCacheEntries.push_back(GetScriptExecutionCacheEntry(tx, flags));
             control.Add(vChecks);
         }
 
@@ -1857,6 +2189,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    for (const uint256& hashCacheEntry : vScriptCacheEntries)
+        scriptExecutionCache.insert(hashCacheEntry);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
@@ -2241,6 +2575,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockCoins(blockConnecting);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2635,10 +2970,9 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex) {
     return true;
 }
 
-static CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+static CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
@@ -2806,14 +3140,19 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWork(hash, block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
     return true;
 }
 
+static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+{
+    return CheckBlockHeader(block, fCheckPOW ? block.GetHash() : uint256(), state, consensusParams, fCheckPOW);
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3066,11 +3405,11 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+/** Accept a header whose hash the caller already computed, possibly without holding cs_main. */
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3085,7 +3424,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus()))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3100,7 +3439,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3110,14 +3449,30 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+{
+    return AcceptBlockHeader(block, block.GetHash(), state, chainparams, ppindex);
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Hash the headers before taking cs_main, X16R is expensive
+    std::vector<uint256> hashes;
+    hashes.reserve(headers.size());
+    for (const CBlockHeader& header : headers)
+        hashes.push_back(header.GetHash());
+    return ProcessNewBlockHeaders(headers, hashes, state, chainparams, ppindex);
+}
+
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<uint256>& hashes, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
+{
+    assert(headers.size() == hashes.size());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(headers[i], hashes[i], state, chainparams, &pindex)) {
                 return false;
             }
             if (ppindex) {
@@ -3972,7 +4327,7 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
             return error("%s: FindBlockPos failed", __func__);
         if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
             return error("%s: writing genesis block to disk failed", __func__);
-        CBlockIndex *pindex = AddToBlockIndex(block);
+        CBlockIndex *pindex = AddToBlockIndex(block, block.GetHash());
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos, chainparams.GetConsensus()))
             return error("%s: genesis block not accepted", __func__);
     } catch (const std::runtime_error& e) {
@@ -4313,7 +4668,90 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_LEGACY = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** Number of transactions read from mempool.dat before checking their scripts and accepting them. */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+struct MempoolDumpEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+};
+
+/**
+ * Check the scripts of transactions about to be submitted to the mempool on
+ * the script check threads, and record each transaction whose inputs all
+ * pass in the script execution cache, so that AcceptToMemoryPool does not
+ * evaluate them again. Inputs are looked up in the chain, the mempool and the
+ * earlier transactions of vtx; transactions with unknown inputs are left to
+ * AcceptToMemoryPool.
+ *
+ * Like every user of the script check queue this holds cs_main throughout,
+ * so that the queue is never waited for with the locks taken in another
+ * order. If pvCoinsToUncache is set, it receives for each transaction the
+ * coins this pulled into pcoinsTip, to be uncached if it is not accepted.
+ */
+static void PrecheckMempoolScripts(const std::vector<CTransactionRef>& vtx, std::vector<std::vector<COutPoint>>* pvCoinsToUncache)
+{
+    LOCK(cs_main);
+    std::vector<PrecomputedTransactionData> vTxData;
+    std::vector<CScriptCheck> vChecks;
+    // Cache entries to insert, by index into vtx
+    std::vector<std::pair<size_t, uint256>> vCacheEntries;
+    // CScriptChecks point into vTxData and vfFailed, which therefore must not reallocate
+    vTxData.reserve(vtx.size());
+    std::unique_ptr<std::atomic<bool>[]> vfFailed(new std::atomic<bool>[vtx.size()]);
+    if (pvCoinsToUncache)
+        pvCoinsToUncache->assign(vtx.size(), std::vector<COutPoint>());
+
+    {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t n = 0; n < vtx.size(); n++) {
+            const CTransaction& tx = *vtx[n];
+            vfFailed[n].store(false, std::memory_order_relaxed);
+            if (tx.IsCoinBase() || mempool.exists(tx.GetHash()))
+                continue;
+            bool fHaveInputs = true;
+            for (const CTxIn& txin : tx.vin) {
+                if (pvCoinsToUncache && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                    (*pvCoinsToUncache)[n].push_back(txin.prevout);
+                if (view.AccessCoin(txin.prevout).IsSpent()) {
+                    fHaveInputs = false;
+                    break;
+                }
+            }
+            if (!fHaveInputs)
+                continue;
+            vTxData.emplace_back(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                vChecks.emplace_back(view.AccessCoin(tx.vin[i].prevout).out, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true, &vTxData.back(), &vfFailed[n]);
+            }
+            // Only the flags the scripts were run under; AcceptToMemoryPool
+            // still re-checks under the tip's block flags and caches those.
+            vCacheEntries.emplace_back(n, GetScriptExecutionCacheEntry(tx, STANDARD_SCRIPT_VERIFY_FLAGS));
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+        }
+    }
+
+    if (vChecks.empty())
+        return;
+
+    {
+        // Failures are recorded per transaction, so the queue always succeeds
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    for (const std::pair<size_t, uint256>& entry : vCacheEntries) {
+        if (!vfFailed[entry.first].load(std::memory_order_relaxed))
+            scriptExecutionCache.insert(entry.second);
+    }
+}
 
 bool LoadMempool(void)
 {
@@ -4335,46 +4773,83 @@ bool LoadMempool(void)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_LEGACY) {
             return false;
         }
+        // Scripts are only prechecked in parallel if the dump was made under
+        // the same policy; otherwise many would fail and every batch would
+        // be validated twice.
+        bool fPrecheck = false;
+        if (version == MEMPOOL_DUMP_VERSION) {
+            uint32_t nScriptFlags;
+            uint256 hashTip;
+            file >> nScriptFlags;
+            file >> hashTip;
+            fPrecheck = nScriptCheckThreads && nScriptFlags == STANDARD_SCRIPT_VERIFY_FLAGS;
+            LogPrint(BCLog::MEMPOOL, "Loading mempool dumped at block %s%s\n", hashTip.ToString(), fPrecheck ? "" : ", without parallel script precheck");
+        }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        std::vector<MempoolDumpEntry> vEntries;
+        std::vector<CTransactionRef> vtxPrecheck;
+        std::vector<std::vector<COutPoint>> vCoinsToUncache;
+        while (num) {
+            vEntries.clear();
+            while (num && vEntries.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                MempoolDumpEntry entry;
+                file >> entry.tx;
+                file >> entry.nTime;
+                file >> entry.nFeeDelta;
+                vEntries.push_back(std::move(entry));
+                --num;
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
+
+            if (fPrecheck) {
+                vtxPrecheck.clear();
+                for (const MempoolDumpEntry& entry : vEntries) {
+                    if (entry.nTime + nExpiryTimeout > nNow)
+                        vtxPrecheck.push_back(entry.tx);
+                }
+                PrecheckMempoolScripts(vtxPrecheck, &vCoinsToUncache);
+            }
+
+            // Index into vtxPrecheck, which holds the unexpired entries
+            size_t nPrecheck = 0;
+            for (const MempoolDumpEntry& entry : vEntries) {
+                const CTransactionRef& tx = entry.tx;
+                CAmount amountdelta = entry.nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                CValidationState state;
+                if (entry.nTime + nExpiryTimeout > nNow) {
+                    LOCK(cs_main);
+                    AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, entry.nTime,
+                                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+                    if (fPrecheck && !mempool.exists(tx->GetHash())) {
+                        for (const COutPoint& outpoint : vCoinsToUncache[nPrecheck])
+                            pcoinsTip->Uncache(outpoint);
+                    }
+                    nPrecheck++;
+                    if (state.IsValid()) {
+                        ++count;
                     } else {
-                        ++failed;
+                        // mempool may contain the transaction already, e.g. from
+                        // wallet(s) having loaded it while we were processing
+                        // mempool transactions; consider these as valid, instead of
+                        // failed, but mark them as 'already there'
+                        if (mempool.exists(tx->GetHash())) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
+                } else {
+                    ++expired;
                 }
-            } else {
-                ++expired;
+                if (ShutdownRequested())
+                    return false;
             }
-            if (ShutdownRequested())
-                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -4397,7 +4872,13 @@ bool DumpMempool(void)
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 hashTip;
 
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip())
+            hashTip = chainActive.Tip()->GetBlockHash();
+    }
     {
         LOCK(mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
@@ -4418,7 +4899,11 @@ bool DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << (uint32_t)STANDARD_SCRIPT_VERIFY_FLAGS;
+        file << hashTip;
 
+        // infoAll() returns parents before their children, which lets
+        // LoadMempool check scripts of whole batches at once
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
             file << *(i.tx);
@@ -4440,6 +4925,109 @@ bool DumpMempool(void)
     return true;
 }
 
+static const uint64_t SCRIPT_CACHE_DUMP_VERSION = 1;
+
+static void WriteCacheEntries(CAutoFile& file, const std::vector<uint256>& entries)
+{
+    file << (uint64_t)entries.size();
+    for (const uint256& entry : entries)
+        file << entry;
+}
+
+static void ReadCacheEntries(CAutoFile& file, std::vector<uint256>& entries)
+{
+    uint64_t num;
+    file >> num;
+    // Don't trust the count for the allocation; a truncated file throws below
+    entries.reserve(std::min<uint64_t>(num, 1 << 20));
+    while (num--) {
+        uint256 entry;
+        file >> entry;
+        entries.push_back(entry);
+    }
+}
+
+bool LoadScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sigNonce, execNonce;
+    std::vector<uint256> vSigEntries, vExecEntries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        file >> sigNonce;
+        ReadCacheEntries(file, vSigEntries);
+        file >> execNonce;
+        ReadCacheEntries(file, vExecEntries);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // Only replace the nonces once the whole file was read, so a damaged
+    // file leaves both caches as freshly initialized.
+    LoadSignatureCache(sigNonce, vSigEntries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = execNonce;
+        for (const uint256& entry : vExecEntries)
+            scriptExecutionCache.insert(entry);
+    }
+    LogPrintf("Imported signature caches from disk: %u signature and %u script execution entries, %.2fs\n",
+        vSigEntries.size(), vExecEntries.size(), (GetTimeMicros() - start) * MICRO);
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sigNonce, execNonce;
+    std::vector<uint256> vSigEntries, vExecEntries;
+    DumpSignatureCache(sigNonce, vSigEntries);
+    {
+        LOCK(cs_main);
+        execNonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.dump(vExecEntries);
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << SCRIPT_CACHE_DUMP_VERSION;
+        file << sigNonce;
+        WriteCacheEntries(file, vSigEntries);
+        file << execNonce;
+        WriteCacheEntries(file, vExecEntries);
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature caches: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == nullptr)